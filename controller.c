@@ -0,0 +1,502 @@
+/*
+ * Single-loop controller for any number of intersections
+ * See controller.h
+ */
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "controller.h"
+#include "detector.h"
+#include "event_loop.h"
+#include "gpio_backend.h"
+#include "input_trace.h"
+#include "journal.h"
+#include "monitor.h"
+#include "phase_timer.h"
+#include "plan_reload.h"
+#include "status_log.h"
+#include "status_page.h"
+#include "telemetry.h"
+#include "timing_stats.h"
+
+static uint64_t deadline_of(const struct controller *ctl, int slot) {
+    return ctl->isects[ctl->heap[slot]].deadline_ns;
+}
+
+// Restore heap order after the deadline at slot moved later
+static void sift_down(struct controller *ctl, int slot) {
+    for (;;) {
+        int left = 2 * slot + 1, right = left + 1, earliest = slot;
+        
+        if (left < ctl->count && deadline_of(ctl, left) < deadline_of(ctl, earliest)) earliest = left;
+        if (right < ctl->count && deadline_of(ctl, right) < deadline_of(ctl, earliest)) earliest = right;
+        if (earliest == slot) return;
+        
+        int tmp = ctl->heap[slot];
+        ctl->heap[slot] = ctl->heap[earliest];
+        ctl->heap[earliest] = tmp;
+        slot = earliest;
+    }
+}
+
+#define EVENT_BUTTONS   EVENT_USER      // The backend's button input descriptor
+
+static struct event_loop loop = EVENT_LOOP_CLOSED;
+static atomic_int flash_request = -1;   // From controller_request_flash(); -1: none
+static int tripped;                     // The conflict monitor tripped
+
+static void signal_set(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGTERM);
+    sigaddset(set, SIGHUP);
+    sigaddset(set, SIGUSR1);
+    sigaddset(set, SIGUSR2);
+}
+
+void controller_block_signals(void) {
+    sigset_t set;
+    
+    signal_set(&set);
+    event_loop_block_signals(&set);
+}
+
+int controller_init(struct controller *ctl, struct intersection *isects, int count) {
+    sigset_t set;
+    
+    signal_set(&set);
+    if (event_loop_open(&loop, &set) != 0) return -1;
+    
+    ctl->isects = isects;
+    ctl->count = count;
+    ctl->button_group = -1;
+    ctl->quiet = 0;
+    ctl->run_for_ns = 0;
+    ctl->dim_percent = 100;
+    ctl->coordinated = 0;
+    for (int i = 0; i < count; i++) ctl->late_ns[i] = 0;
+    ctl->schedule = NULL;
+    ctl->schedule_ns = UINT64_MAX;
+    ctl->scheduled_flash = 0;
+    ctl->flash = 0;
+    ctl->flashing = 0;
+    for (int i = 0; i < count; i++) ctl->heap[i] = i;
+    return 0;
+}
+
+void controller_wake(void) {
+    event_loop_wake(&loop);
+}
+
+void controller_request_flash(int on) {
+    atomic_store(&flash_request, on != 0);
+    event_loop_wake(&loop);
+}
+
+void controller_close(void) {
+    event_loop_close(&loop);
+}
+
+// Enter a phase and accumulate its pin writes
+static void enter_phase(struct intersection *isect, int phase, uint64_t start_ns,
+                        struct gpio_mask *set_mask, struct gpio_mask *clear_mask) {
+    isect->phase = phase;
+    if (phase == 0) isect->cycle++;
+    isect->phase_start_ns = start_ns;
+    isect->deadline_ns = start_ns + (uint64_t)isect->table->plan.phases[phase].duration_us * 1000;
+    
+    gpio_mask_or(set_mask, &isect->table->masks[phase].set_mask);
+    gpio_mask_or(clear_mask, &isect->table->masks[phase].clear_mask);
+}
+
+// How far into its coordinated cycle an intersection is at wall-clock real_ns
+static uint64_t cycle_position(const struct intersection *isect, int64_t real_ns) {
+    int64_t cycle = (int64_t)isect->table->cycle_ns;
+    int64_t pos = (real_ns - (int64_t)(isect->offset_ns % isect->table->cycle_ns)) % cycle;
+    
+    return pos < 0 ? pos + cycle : pos;
+}
+
+// Move the end of the phase 0 just entered so the next cycle starts on the
+// wall clock, by at most 1/COORD_MAX_ADJUST of the phase
+static void coordinate(struct intersection *isect) {
+    int64_t cycle = (int64_t)isect->table->cycle_ns;
+    int64_t limit = (int64_t)(isect->deadline_ns - isect->phase_start_ns) / COORD_MAX_ADJUST;
+    int64_t late = cycle_position(isect, isect->phase_start_ns + input_trace_offset(clock_realtime_offset_ns()));
+    
+    if (late > cycle / 2) late -= cycle;    // Started early
+    if (late > limit) late = limit;
+    if (late < -limit) late = -limit;
+    isect->deadline_ns -= late;
+}
+
+void controller_print_status(FILE *fp, const struct status_record *latest, int count,
+                             const struct status_record *rec, void *arg) {
+    const struct intersection *isects = arg;
+    
+    fprintf(fp, "\r");
+    for (int i = 0; i < count; i++) {
+        if (latest[i].flags & STATUS_FLASH) {
+            fprintf(fp, "[%s] FLASH ", isects[i].name);
+            continue;
+        }
+        fprintf(fp, "[%s %03u] A:%-6s B:%-6s%s ", isects[i].name, latest[i].cycle,
+                street_color(latest[i].heads, HEAD_A_RED), street_color(latest[i].heads, HEAD_B_RED),
+                latest[i].flags & STATUS_PED_CALL ? " WAIT" : "");
+    }
+}
+
+// Queue the state of one intersection for the status line and telemetry
+static void log_status(const struct controller *ctl, int index) {
+    const struct intersection *isect = &ctl->isects[index];
+    struct status_record rec = {
+        .time_ns = isect->phase_start_ns,
+        .heads = isect->table->plan.phases[isect->phase].heads,
+        .cycle = isect->cycle,
+        .isect = index,
+        .phase = isect->phase,
+        .flags = (isect->ped_call ? STATUS_PED_CALL : 0) | (ctl->flashing ? STATUS_FLASH : 0),
+    };
+    
+    if (!ctl->quiet) status_log(&rec);
+    telemetry_publish(index, isect, ctl->flashing, ctl->late_ns[index]);
+    status_page_publish(index, isect, ctl->flashing, ctl->late_ns[index]);
+}
+
+// Show the current phase on the PWM heads
+static void update_pwm(const struct controller *ctl, struct intersection *isect) {
+    head_mask_t lit = isect->table->plan.phases[isect->phase].heads;
+    uint64_t duty = PWM_DIM_PERIOD_NS * ctl->dim_percent / 100;
+    
+    for (int i = 0; i < isect->num_pwm; i++) {
+        int on = (lit & HEAD_BIT(isect->pwm[i].head)) != 0;
+        
+        (void)pwm_set(&isect->pwm[i].pwm, PWM_DIM_PERIOD_NS, on ? duty : 0);
+    }
+}
+
+// One output write, recorded or checked against the trace
+static void write_outputs(const struct gpio_mask *set_mask, const struct gpio_mask *clear_mask) {
+    gpio_apply_banks(set_mask, clear_mask);
+    (void)input_trace_output(set_mask, clear_mask);
+}
+
+// Hand the flash heads to the PWM block and stop the plans
+static void enter_flash(struct controller *ctl) {
+    struct gpio_mask set_mask = { 0 }, clear_mask = { 0 };
+    
+    for (int i = 0; i < ctl->count; i++) {
+        struct intersection *isect = &ctl->isects[i];
+        
+        gpio_mask_or(&set_mask, &isect->flash_masks.set_mask);
+        gpio_mask_or(&clear_mask, &isect->flash_masks.clear_mask);
+        for (int p = 0; p < isect->num_pwm; p++) {
+            int flash = (isect->flash_heads & HEAD_BIT(isect->pwm[p].head)) != 0;
+            
+            (void)pwm_set(&isect->pwm[p].pwm, PWM_FLASH_PERIOD_NS, flash ? PWM_FLASH_PERIOD_NS / 2 : 0);
+        }
+    }
+    write_outputs(&set_mask, &clear_mask);
+    ctl->flashing = 1;
+    for (int i = 0; i < ctl->count; i++) log_status(ctl, i);
+}
+
+// Latch every queued button press on the intersection that owns the button
+static void read_buttons(struct controller *ctl) {
+    struct gpio_input_event events[16];
+    const struct gpio_input_event *field;
+    size_t len;
+    int count;
+    
+    if ((field = input_trace_take(TRACE_BUTTONS, &len))) {
+        count = len / sizeof(events[0]);
+        memcpy(events, field, len);
+    } else {
+        count = gpio_backend->read_inputs(ctl->button_group, events, 16);
+        if (count > 0) input_trace_put(TRACE_BUTTONS, events, count * sizeof(events[0]));
+    }
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < ctl->count; j++) {
+            if (ctl->isects[j].button_mask & (1u << events[i].pin)) {
+                intersection_call(&ctl->isects[j], events[i].time_ns);
+                log_status(ctl, j);
+            }
+        }
+    }
+}
+
+// Extend actuated phases for every queued detector pulse
+// Returns non-zero if any deadline moved.
+static int drain_detectors(struct controller *ctl) {
+    struct gpio_input_event events[64];
+    size_t len;
+    int count, moved = 0;
+    
+    for (;;) {
+        const struct gpio_input_event *field = input_trace_take(TRACE_DETECTORS, &len);
+        
+        if (field) {
+            count = len / sizeof(events[0]);
+            memcpy(events, field, len);
+        } else if (input_trace_replaying() || (count = detector_drain(events, 64)) <= 0) {
+            break;
+        } else {
+            input_trace_put(TRACE_DETECTORS, events, count * sizeof(events[0]));
+        }
+        for (int i = 0; i < count; i++) {
+            for (int slot = 0; slot < ctl->count; slot++) {
+                struct intersection *isect = &ctl->isects[ctl->heap[slot]];
+                
+                if (!(isect->detector_mask & (1u << events[i].pin))) continue;
+                if (intersection_actuate(isect, events[i].pin, events[i].time_ns)) {
+                    sift_down(ctl, slot);
+                    moved = 1;
+                }
+                break;
+            }
+        }
+    }
+    return moved;
+}
+
+// The next signal the field took here in a replay, else the next one sent
+// to the process
+static int next_signal(void) {
+    const int32_t *field = input_trace_take(TRACE_SIGNAL, NULL);
+    int32_t sig;
+    
+    if (field) return *field;
+    sig = event_loop_signal(&loop);
+    if (sig) input_trace_put(TRACE_SIGNAL, &sig, sizeof(sig));
+    return sig;
+}
+
+// Act on every signal sent to the process since the last wakeup
+static void take_signals(struct controller *ctl, volatile int *keep_running) {
+    int sig;
+    
+    while ((sig = next_signal()) != 0) {
+        switch (sig) {
+        case SIGUSR1:
+            timing_stats_request_dump();
+            break;
+        case SIGUSR2:
+            ctl->flash = !ctl->flash;
+            break;
+        case SIGHUP:
+            plan_reload_request();
+            break;
+        default:            // SIGINT, SIGTERM
+            *keep_running = 0;
+            break;
+        }
+    }
+}
+
+// Take a mode change asked for over telemetry and a tripped conflict
+// monitor, from the trace in a replay
+static void take_requests(struct controller *ctl) {
+    const int32_t *field;
+    int32_t request;
+    int was_tripped = tripped;
+    
+    if (input_trace_replaying()) {
+        if ((field = input_trace_take(TRACE_FLASH, NULL))) ctl->flash = *field;
+        if (input_trace_take(TRACE_TRIP, NULL)) tripped = 1;
+    } else {
+        request = atomic_exchange(&flash_request, -1);
+        if (request >= 0) {
+            ctl->flash = request;
+            input_trace_put(TRACE_FLASH, &request, sizeof(request));
+        }
+        if (!tripped && monitor_tripped()) {
+            unsigned int state;
+            
+            tripped = 1;
+            input_trace_put(TRACE_TRIP, NULL, 0);
+            status_page_conflict(monitor_fault(&state));
+        }
+    }
+    
+    // A conflict holds flash mode until restart, whatever else asks. The
+    // flash is written again even if it is already on, since the monitor
+    // saw the lights show something else.
+    if (tripped) ctl->flash = 1;
+    if (tripped && !was_tripped) ctl->flashing = 0;
+}
+
+// In a replay, the source of the field's next input if it came while the
+// loop waited here; 0 to wait as the field did
+static uint32_t traced_ready(void) {
+    switch (input_trace_due()) {
+    case TRACE_BUTTONS:
+        return EVENT_BIT(EVENT_BUTTONS);
+    case TRACE_SIGNAL:
+        return EVENT_BIT(EVENT_SIGNAL);
+    case TRACE_FLASH:
+    case TRACE_TRIP:
+        return EVENT_BIT(EVENT_WAKE);
+    default:
+        return 0;
+    }
+}
+
+// Point every intersection at a calendar plan for its next cycle
+static void schedule_plans(struct controller *ctl, int plan) {
+    if (plan == SCHEDULE_NONE) return;
+    if (plan == SCHEDULE_FLASH) {
+        ctl->flash = ctl->scheduled_flash = 1;
+        return;
+    }
+    
+    // Only undo a flash the calendar started, not one an operator asked for
+    if (ctl->scheduled_flash) ctl->flash = ctl->scheduled_flash = 0;
+    for (int i = 0; i < ctl->count; i++) ctl->isects[i].next_plan = ctl->schedule->plan_index[plan][i];
+}
+
+// Arm the next calendar change as a CLOCK_MONOTONIC deadline
+static void arm_schedule(struct controller *ctl) {
+    int64_t due = schedule_next_ns(ctl->schedule) - input_trace_offset(clock_realtime_offset_ns());
+    
+    ctl->schedule_ns = due > 0 ? (uint64_t)due : 0;
+}
+
+// Take every calendar change that is due
+static void fire_schedule(struct controller *ctl) {
+    while (ctl->schedule_ns <= clock_now_ns()) {
+        schedule_plans(ctl, schedule_fire(ctl->schedule));
+        arm_schedule(ctl);
+    }
+}
+
+// Put every intersection in phase 0 at start_ns, or where the wall clock
+// says it should be in coordinated mode, and write the outputs
+static void start_plans(struct controller *ctl, uint64_t start_ns) {
+    struct gpio_mask set_mask = { 0 }, clear_mask = { 0 };
+    
+    int64_t real_offset = input_trace_offset(clock_realtime_offset_ns());
+    
+    for (int i = 0; i < ctl->count; i++) {
+        struct intersection *isect = &ctl->isects[i];
+        uint64_t into = 0;
+        int phase = 0;
+        
+        isect->ped_call = 0;
+        isect->resume = 0;
+        input_trace_start_cycle(isect, i);
+        if (ctl->coordinated) {
+            // Join the cycle part way through, in the phase the others expect
+            into = cycle_position(isect, start_ns + real_offset);
+            for (int n = 0; n < isect->table->plan.num_phases; n++) {
+                const struct phase *p = &isect->table->plan.phases[phase];
+                
+                if (into < (uint64_t)p->duration_us * 1000) break;
+                into -= (uint64_t)p->duration_us * 1000;
+                phase = p->next == PHASE_RETURN ? 0 : p->next;
+            }
+        }
+        enter_phase(isect, phase, start_ns - into, &set_mask, &clear_mask);
+        if (isect->cycle == 0) isect->cycle = 1;
+        ctl->heap[i] = i;
+    }
+    for (int slot = ctl->count / 2 - 1; slot >= 0; slot--) sift_down(ctl, slot);
+    write_outputs(&set_mask, &clear_mask);
+    ctl->flashing = 0;
+    
+    for (int i = 0; i < ctl->count; i++) {
+        update_pwm(ctl, &ctl->isects[i]);
+        journal_record(&ctl->isects[i], i, start_ns, start_ns);
+        log_status(ctl, i);
+    }
+}
+
+void controller_run(struct controller *ctl, volatile int *keep_running) {
+    struct gpio_mask set_mask, clear_mask;
+    uint64_t epoch = input_trace_clock(clock_now_ns());
+    uint64_t stop = ctl->run_for_ns ? epoch + ctl->run_for_ns : UINT64_MAX;
+    
+    // Every intersection starts its cycle at the same epoch, unless the
+    // wall clock decides
+    for (int i = 0; i < ctl->count; i++) ctl->isects[i].cycle = 0;
+    if (ctl->button_group >= 0 && gpio_backend->input_fd(ctl->button_group) >= 0) {
+        (void)event_loop_add(&loop, gpio_backend->input_fd(ctl->button_group), EVENT_BUTTONS);
+    }
+    if (ctl->schedule) {
+        schedule_plans(ctl, schedule_compile(ctl->schedule, (int64_t)epoch + input_trace_offset(clock_realtime_offset_ns())));
+        arm_schedule(ctl);
+    }
+    if (ctl->flash) enter_flash(ctl);
+    else start_plans(ctl, epoch);
+    
+    while (*keep_running) {
+        uint64_t wake, tick_end, scheduled[MAX_INTERSECTIONS], write_start;
+        uint32_t ready;
+        int due[MAX_INTERSECTIONS], num_due = 0;
+        
+        timing_stats_poll(stdout, ctl->isects, ctl->count);
+        
+        take_requests(ctl);
+        if (ctl->flash != ctl->flashing) {
+            if (ctl->flash) enter_flash(ctl);
+            else start_plans(ctl, input_trace_clock(clock_now_ns()));
+            continue;
+        }
+        
+        // Flash mode has no deadlines, only the end of the run and the calendar
+        if (ctl->flashing) {
+            if (clock_now_ns() >= stop) break;
+            wake = stop < ctl->schedule_ns ? stop : ctl->schedule_ns;
+        } else {
+            if (deadline_of(ctl, 0) > stop) break;
+            wake = ctl->schedule_ns < deadline_of(ctl, 0) ? ctl->schedule_ns : deadline_of(ctl, 0);
+        }
+        
+        // A replay stops where the field did
+        input_trace_at(wake);
+        if (input_trace_finished()) break;
+        
+        // Anything but the deadline is dealt with before looking at it
+        // again; button presses never move a deadline
+        ready = traced_ready();
+        if (!ready) ready = event_loop_wait(&loop, wake);
+        if (ready & EVENT_BIT(EVENT_SIGNAL)) take_signals(ctl, keep_running);
+        if ((ready & EVENT_BIT(EVENT_BUTTONS)) || input_trace_due() == TRACE_BUTTONS) read_buttons(ctl);
+        if (ready != EVENT_BIT(EVENT_TIMER)) continue;
+        fire_schedule(ctl);
+        if (ctl->flashing || wake < deadline_of(ctl, 0)) continue;
+        
+        // A pulse that arrived during the sleep may hold the phase longer
+        if (drain_detectors(ctl) && deadline_of(ctl, 0) > input_trace_clock(clock_now_ns())) continue;
+        
+        // Advance everything due in this tick, then write once
+        set_mask = clear_mask = (struct gpio_mask){ 0 };
+        tick_end = deadline_of(ctl, 0) + COALESCE_NS;
+        while (deadline_of(ctl, 0) < tick_end) {
+            struct intersection *isect = &ctl->isects[ctl->heap[0]];
+            
+            due[num_due] = ctl->heap[0];
+            scheduled[num_due++] = isect->deadline_ns;
+            
+            // The next phase starts at the planned deadline, not now; a
+            // reloaded or scheduled plan takes over as a cycle starts
+            int next = intersection_next_phase(isect);
+            
+            if (next == 0) input_trace_start_cycle(isect, ctl->heap[0]);
+            enter_phase(isect, next, isect->deadline_ns, &set_mask, &clear_mask);
+            if (ctl->coordinated && isect->phase == 0) coordinate(isect);
+            sift_down(ctl, 0);
+        }
+        
+        write_start = clock_now_ns();
+        write_outputs(&set_mask, &clear_mask);
+        timing_record_write(clock_now_ns() - write_start);
+        for (int i = 0; i < num_due; i++) {
+            timing_record_phase(due[i], ctl->isects[due[i]].phase, scheduled[i], write_start);
+            ctl->late_ns[due[i]] = (int64_t)(write_start - scheduled[i]);
+            update_pwm(ctl, &ctl->isects[due[i]]);
+            journal_record(&ctl->isects[due[i]], due[i], scheduled[i], write_start);
+            log_status(ctl, due[i]);
+        }
+    }
+}
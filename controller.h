@@ -0,0 +1,106 @@
+/*
+ * Single-loop controller for any number of intersections
+ *
+ * Each intersection keeps its own absolute phase deadline. The controller
+ * holds them in a min-heap and advances every intersection due within the
+ * same tick before writing the outputs once. Everything it waits for is in
+ * one event loop (see event_loop.h): a timerfd armed with the earliest
+ * deadline, the backend's button descriptor, a signalfd for the process's
+ * signals and the wake eventfd, so it makes no wakeups between events.
+ * Detector pulses are drained from their ring when a deadline passes and
+ * may push it later before it is acted on.
+ *
+ * In coordinated mode every cycle is tied to the wall clock: phase 0 starts
+ * whenever CLOCK_REALTIME minus the intersection's offset is a whole number
+ * of cycles, so controllers kept in step by NTP or PTP hold a green wave
+ * without talking to each other. Drift, clock steps and actuated time are
+ * taken out by stretching or trimming phase 0.
+ *
+ * With a calendar (see schedule.h) its next plan change is armed as one
+ * more deadline; when it passes, each intersection is pointed at its new
+ * plan and switches at its next cycle.
+ *
+ * In flash mode the PWM heads flash by themselves, so the loop has no
+ * deadlines and just waits until it is told to go back to the plan. Once
+ * the conflict monitor trips it never goes back.
+ *
+ * The loop takes the process's signals itself: SIGINT and SIGTERM stop
+ * it, SIGUSR1 asks for a timing report, SIGUSR2 switches between the plans
+ * and flash mode, and SIGHUP reloads the plans (see plan_reload.h).
+ *
+ * Every input the loop takes, and every output write it makes, goes
+ * through input_trace.h, so a run can be recorded and replayed. State
+ * changes are published to the telemetry server and the shared status
+ * page (see status_page.h) when they are running.
+ */
+
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <signal.h>
+#include "intersection.h"
+#include "schedule.h"
+#include "status_log.h"
+
+// Deadlines closer together than this share one output write
+#define COALESCE_NS     1000000ULL   // 1 ms
+
+// Coordinated mode changes phase 0 by at most 1/COORD_MAX_ADJUST per cycle
+#define COORD_MAX_ADJUST    4
+
+struct controller {
+    struct intersection *isects;
+    int count;
+    int heap[MAX_INTERSECTIONS];    // Intersection indices, earliest deadline first
+    
+    int button_group;               // Backend input group of the buttons, or -1
+    int quiet;                      // Don't log the status line
+    uint64_t run_for_ns;            // Stop after this long (0 = run until stopped)
+    int dim_percent;                // Brightness of PWM heads (100 = full)
+    int coordinated;                // Lock cycles to CLOCK_REALTIME plus each offset
+    int64_t late_ns[MAX_INTERSECTIONS];     // How late each last phase change was written
+    struct schedule *schedule;      // Calendar of plan changes, or NULL
+    uint64_t schedule_ns;           // When its next change is due (UINT64_MAX = never)
+    int scheduled_flash;            // The calendar put the controller in flash mode
+    
+    // Set (by SIGUSR2, the calendar or controller_request_flash()) to
+    // switch to flash mode, cleared to restart the plans from phase 0.
+    // Only the loop writes it once it runs.
+    volatile sig_atomic_t flash;
+    int flashing;                   // Mode the outputs are in now
+};
+
+// Block the signals the loop takes, so no thread is interrupted by them.
+// Call before starting any thread.
+void controller_block_signals(void);
+
+// Set up the controller and its event loop
+// Returns 0 on success, -1 after printing an error.
+int controller_init(struct controller *ctl, struct intersection *isects, int count);
+
+// Make the loop look at the conflict monitor now instead of at its next
+// deadline. Safe to call from any thread.
+void controller_wake(void);
+
+// Ask the loop to enter (on non-zero) or leave flash mode, and wake it.
+// Safe to call from any thread; the loop takes the latest request.
+void controller_request_flash(int on);
+
+// Close the event loop once the threads that wake it have stopped
+void controller_close(void);
+
+// Start every intersection at phase 0 (in coordinated mode, wherever the
+// wall clock puts it in its cycle) and run until *keep_running is cleared,
+// which SIGINT and SIGTERM do.
+// Phase changes are queued to the status logger and published to the
+// telemetry server if they are running.
+void controller_run(struct controller *ctl, volatile int *keep_running);
+
+// status_print_fn for the one-line status of every intersection;
+// arg is the intersection array
+void controller_print_status(FILE *fp, const struct status_record *latest, int count,
+                             const struct status_record *rec, void *arg);
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Vehicle detector input
+ * See detector.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "detector.h"
+#include "event_loop.h"
+
+#define RING_MASK       (DETECTOR_RING_SIZE - 1)
+#define EVENT_INPUT     EVENT_USER      // The detector request's descriptor
+
+// head and tail only ever increase; their difference is the fill level.
+// Each is written by one side only and lives on its own cache line.
+static struct {
+    _Alignas(64) atomic_uint head;      // Next slot the input thread fills
+    _Alignas(64) atomic_uint tail;      // Next slot the control loop reads
+    struct gpio_input_event events[DETECTOR_RING_SIZE];
+} ring;
+
+static atomic_ullong dropped;
+static atomic_int running;
+static pthread_t thread;
+static struct event_loop loop = EVENT_LOOP_CLOSED;
+static int group = -1;
+
+static void push(const struct gpio_input_event *ev) {
+    unsigned int head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    
+    if (head - tail == DETECTOR_RING_SIZE) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring.events[head & RING_MASK] = *ev;
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+}
+
+// Sleeps until an edge arrives or detector_stop() wakes it
+static void *input_thread(void *arg) {
+    struct gpio_input_event events[32];
+    
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        if (!(event_loop_wait(&loop, EVENT_NEVER) & EVENT_BIT(EVENT_INPUT))) continue;
+        
+        int count = gpio_backend->read_inputs(group, events, 32);
+        for (int i = 0; i < count; i++) push(&events[i]);
+    }
+    return NULL;
+}
+
+int detector_start(const unsigned int *pins, int count) {
+    int err;
+    
+    if (!gpio_backend->configure_inputs) {
+        fprintf(stderr, "The %s backend has no detector inputs; use gpiod\n", gpio_backend->name);
+        return -1;
+    }
+    group = gpio_backend->configure_inputs(pins, count, DETECTOR_DEBOUNCE_US);
+    if (group < 0) return -1;
+    
+    // Simulated inputs have nothing to wait on
+    if (gpio_backend->input_fd(group) < 0) return 0;
+    if (event_loop_open(&loop, NULL) != 0) return -1;
+    if (event_loop_add(&loop, gpio_backend->input_fd(group), EVENT_INPUT) != 0) {
+        event_loop_close(&loop);
+        return -1;
+    }
+    
+    atomic_store(&running, 1);
+    err = pthread_create(&thread, NULL, input_thread, NULL);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start detector thread: %s\n", strerror(err));
+        atomic_store(&running, 0);
+        event_loop_close(&loop);
+        return -1;
+    }
+    return 0;
+}
+
+void detector_stop(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&running, 0);
+    event_loop_wake(&loop);
+    pthread_join(thread, NULL);
+    event_loop_close(&loop);
+}
+
+int detector_drain(struct gpio_input_event *events, int max) {
+    unsigned int tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring.head, memory_order_acquire);
+    int count = 0;
+    
+    while (tail != head && count < max) events[count++] = ring.events[tail++ & RING_MASK];
+    atomic_store_explicit(&ring.tail, tail, memory_order_release);
+    return count;
+}
+
+uint64_t detector_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
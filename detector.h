@@ -0,0 +1,35 @@
+/*
+ * Vehicle detector input
+ *
+ * Detector loops are wired as GPIO inputs that pulse high for each
+ * vehicle. An input thread sleeps in its own event loop until their edge
+ * events arrive, with no wakeups in between, and pushes each one into a
+ * single-producer/single-consumer ring; the control loop drains the ring
+ * without locks before acting on a deadline. A full ring drops the new
+ * event and counts it, so a burst of pulses never blocks either side.
+ */
+
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <stdint.h>
+#include "gpio_backend.h"
+
+#define DETECTOR_RING_SIZE      1024    // Events; must be a power of two
+#define DETECTOR_DEBOUNCE_US    1000
+
+// Request the detector pins from the selected backend and start the input
+// thread. Returns 0 on success, -1 after printing an error.
+int detector_start(const unsigned int *pins, int count);
+
+// Stop the input thread
+void detector_stop(void);
+
+// Move up to max queued events into events. Returns the count.
+// Only the control loop may call this.
+int detector_drain(struct gpio_input_event *events, int max);
+
+// Events lost because the ring was full
+uint64_t detector_dropped(void);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * One epoll descriptor for everything a thread waits on
+ * See event_loop.h
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "event_loop.h"
+#include "phase_timer.h"
+
+#define NSEC_PER_SEC    1000000000ULL
+#define MAX_EVENTS      32      // Ready descriptors taken per wait
+
+void event_loop_block_signals(const sigset_t *signals) {
+    pthread_sigmask(SIG_BLOCK, signals, NULL);
+}
+
+static int watch(struct event_loop *loop, int fd, int id) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)id };
+    
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int event_loop_open(struct event_loop *loop, const sigset_t *signals) {
+    loop->timer_fd = loop->signal_fd = loop->wake_fd = -1;
+    loop->armed_ns = EVENT_NEVER;
+    
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) goto fail;
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->timer_fd < 0 || loop->wake_fd < 0) goto fail;
+    if (signals) {
+        loop->signal_fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (loop->signal_fd < 0 || watch(loop, loop->signal_fd, EVENT_SIGNAL) != 0) goto fail;
+    }
+    if (watch(loop, loop->timer_fd, EVENT_TIMER) != 0 || watch(loop, loop->wake_fd, EVENT_WAKE) != 0) goto fail;
+    return 0;
+    
+fail:
+    perror("event loop");
+    event_loop_close(loop);
+    return -1;
+}
+
+int event_loop_add(struct event_loop *loop, int fd, int id) {
+    if (watch(loop, fd, id) != 0) {
+        perror("event loop");
+        return -1;
+    }
+    return 0;
+}
+
+// Timer expirations and wake counts don't matter, only that there were some
+static void drain(int fd) {
+    uint64_t count;
+    
+    if (read(fd, &count, sizeof count) < 0) return;
+}
+
+// Point the timer at an absolute deadline; it stays there until it changes
+static void arm(struct event_loop *loop, uint64_t deadline_ns) {
+    struct itimerspec its = { 0 };      // All zero disarms
+    
+    if (deadline_ns == loop->armed_ns) return;
+    if (deadline_ns != EVENT_NEVER) {
+        its.it_value.tv_sec = deadline_ns / NSEC_PER_SEC;
+        its.it_value.tv_nsec = deadline_ns % NSEC_PER_SEC;
+        if (deadline_ns == 0) its.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    loop->armed_ns = deadline_ns;
+}
+
+uint32_t event_loop_wait(struct event_loop *loop, uint64_t deadline_ns) {
+    struct epoll_event events[MAX_EVENTS];
+    uint32_t ready = 0;
+    int count, timeout = 0;
+    
+    // An expiry already taken doesn't fire again: don't block on it.
+    // Without a deadline there is no time to jump to, so even the virtual
+    // clock blocks.
+    if (deadline_ns == EVENT_NEVER || (!clock_is_virtual() && clock_now_ns() < deadline_ns)) {
+        arm(loop, deadline_ns);
+        timeout = -1;
+    }
+    
+    count = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, timeout);
+    for (int i = 0; i < count; i++) {
+        uint32_t id = events[i].data.u32;
+    
+        if (id == EVENT_TIMER) drain(loop->timer_fd);
+        else if (id == EVENT_WAKE) drain(loop->wake_fd);
+        ready |= EVENT_BIT(id);
+    }
+    
+    // Fast-forward once there is nothing else to do
+    if (clock_is_virtual() && !ready && timeout == 0) sleep_until_ns(deadline_ns);
+    
+    // The clock decides, not a stale expiry of an earlier deadline
+    ready &= ~EVENT_BIT(EVENT_TIMER);
+    if (clock_now_ns() >= deadline_ns) ready |= EVENT_BIT(EVENT_TIMER);
+    return ready;
+}
+
+int event_loop_signal(struct event_loop *loop) {
+    struct signalfd_siginfo info;
+    
+    if (loop->signal_fd < 0 || read(loop->signal_fd, &info, sizeof info) != sizeof info) return 0;
+    return (int)info.ssi_signo;
+}
+
+void event_loop_wake(struct event_loop *loop) {
+    uint64_t one = 1;
+    
+    if (write(loop->wake_fd, &one, sizeof one) < 0) return;
+}
+
+void event_loop_close(struct event_loop *loop) {
+    if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+    if (loop->timer_fd >= 0) close(loop->timer_fd);
+    if (loop->signal_fd >= 0) close(loop->signal_fd);
+    if (loop->wake_fd >= 0) close(loop->wake_fd);
+    loop->epoll_fd = loop->timer_fd = loop->signal_fd = loop->wake_fd = -1;
+}
@@ -0,0 +1,72 @@
+/*
+ * One epoll descriptor for everything a thread waits on
+ *
+ * An event loop is an epoll descriptor with three sources built in: a
+ * timerfd armed with an absolute CLOCK_MONOTONIC deadline, an optional
+ * signalfd for signals the process keeps blocked, and an eventfd that
+ * any thread (or a signal handler) can use to wake the loop. Other
+ * descriptors - gpiod edge requests, sockets - are added with an id of
+ * their own, and event_loop_wait() reports every source that is ready as
+ * one bit in a mask. A thread waiting on nothing but its sources makes no
+ * wakeups at all between events.
+ *
+ * On the virtual clock a wait with a deadline never blocks: ready
+ * descriptors are collected without waiting, and time then jumps to the
+ * deadline.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <signal.h>
+
+#define EVENT_TIMER         0       // The deadline has passed
+#define EVENT_SIGNAL        1       // event_loop_signal() has signals to read
+#define EVENT_WAKE          2       // event_loop_wake() was called
+#define EVENT_USER          3       // First id for event_loop_add()
+#define EVENT_BIT(id)       (1u << (id))
+
+#define EVENT_NEVER         UINT64_MAX      // Deadline that never passes
+
+struct event_loop {
+    int epoll_fd;
+    int timer_fd;
+    int signal_fd;                  // -1 without signals
+    int wake_fd;
+    uint64_t armed_ns;              // Deadline the timer is set to
+};
+
+// Initialiser for a loop not opened yet; waking or closing it does nothing
+#define EVENT_LOOP_CLOSED   { .epoll_fd = -1, .timer_fd = -1, .signal_fd = -1, .wake_fd = -1, \
+                              .armed_ns = EVENT_NEVER }
+
+// Block signals in the calling thread; threads created afterwards inherit
+// the mask. Call before starting any thread, so only a signalfd sees them.
+void event_loop_block_signals(const sigset_t *signals);
+
+// Create a loop, with a signalfd for blocked signals unless signals is
+// NULL. Returns 0, or -1 after printing an error.
+int event_loop_open(struct event_loop *loop, const sigset_t *signals);
+
+// Watch fd for input, reported as bit id (EVENT_USER to 31)
+// Returns 0, or -1 after printing an error.
+int event_loop_add(struct event_loop *loop, int fd, int id);
+
+// Wait until the absolute CLOCK_MONOTONIC deadline_ns or until a source
+// is ready. Returns the mask of ready sources (EVENT_BIT(id) each); 0
+// only if the wait was interrupted.
+uint32_t event_loop_wait(struct event_loop *loop, uint64_t deadline_ns);
+
+// Take one pending signal from the signalfd. Returns its number, or 0 if
+// there are none.
+int event_loop_signal(struct event_loop *loop);
+
+// Make the loop's wait return EVENT_WAKE. Safe from any thread and from
+// signal handlers.
+void event_loop_wake(struct event_loop *loop);
+
+// Close every descriptor of the loop (not the ones added to it)
+void event_loop_close(struct event_loop *loop);
+
+#endif
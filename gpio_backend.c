@@ -0,0 +1,52 @@
+/*
+ * GPIO backend registry
+ * See gpio_backend.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "gpio_backend.h"
+
+#if defined(GPIO_BACKEND_STATIC_MMAP)
+#define STATIC_BACKEND  &gpio_mmap_backend
+#elif defined(GPIO_BACKEND_STATIC_RP1)
+#define STATIC_BACKEND  &gpio_rp1_backend
+#elif defined(GPIO_BACKEND_STATIC_GPIOD)
+#define STATIC_BACKEND  &gpio_gpiod_backend
+#elif defined(GPIO_BACKEND_STATIC_SIM)
+#define STATIC_BACKEND  &gpio_sim_backend
+#endif
+
+const struct gpio_backend *const gpio_backends[] = {
+#ifdef STATIC_BACKEND
+    STATIC_BACKEND,
+#else
+#ifdef HAVE_GPIO_RP1
+    &gpio_rp1_backend,                  // First: the default must be right for a Pi 5
+#endif
+#ifdef HAVE_GPIO_MMAP
+    &gpio_mmap_backend,
+#endif
+#ifdef HAVE_LIBGPIOD
+    &gpio_gpiod_backend,
+#endif
+    &gpio_sim_backend,
+#endif
+    NULL
+};
+
+const struct gpio_backend *gpio_backend;
+
+int gpio_backend_select(const char *name) {
+    for (int i = 0; gpio_backends[i] != NULL; i++) {
+        if (!name || strcmp(name, gpio_backends[i]->name) == 0) {
+            gpio_backend = gpio_backends[i];
+            return 0;
+        }
+    }
+    
+    fprintf(stderr, "Unknown GPIO backend '%s'. Available:", name);
+    for (int i = 0; gpio_backends[i] != NULL; i++) fprintf(stderr, " %s", gpio_backends[i]->name);
+    fprintf(stderr, "\n");
+    return -1;
+}
@@ -0,0 +1,144 @@
+/*
+ * GPIO backend interface
+ *
+ * Every way of driving the heads (memory-mapped registers, the Pi 5's
+ * RP1 registers, libgpiod, simulation) provides the same small set of
+ * operations on pin masks. Pins are GPIO numbers 0-31; bit n of a mask is
+ * GPIO n. Outputs on I/O expanders are banks 1-3 of a struct gpio_mask;
+ * gpio_apply_banks() writes a transition across all of them.
+ *
+ * Programs normally pick a backend at startup with gpio_backend_select().
+ * Building with GPIO_BACKEND_STATIC_<NAME> defined binds one backend at
+ * compile time instead: gpio_apply() and gpio_read_levels() then call it
+ * directly (for mmap, inline down to the register stores) and only that
+ * backend can be selected.
+ */
+
+#ifndef GPIO_BACKEND_H
+#define GPIO_BACKEND_H
+
+#include <stdint.h>
+#include "gpio_expander.h"
+#include "gpio_mask.h"
+
+#define MAX_INPUT_GROUPS    4
+
+// A button press or detector pulse reported by a backend
+struct gpio_input_event {
+    uint64_t time_ns;       // CLOCK_MONOTONIC time of the edge
+    unsigned int pin;
+};
+
+struct gpio_backend {
+    const char *name;
+    
+    // Non-zero if apply may be called from two threads at once: set and
+    // clear are single register stores (mmap, RP1). The others keep the
+    // levels in memory, so one thread must do all the writing.
+    int concurrent_apply;
+    
+    // Open the device. Returns 0 on success, -1 after printing an error.
+    int (*init)(void);
+    
+    // Make the pins outputs, driven low. Returns 0 or -1 like init.
+    int (*configure_outputs)(const unsigned int *pins, int count);
+    
+    // Drive set_mask pins high, then clear_mask pins low
+    void (*apply)(uint32_t set_mask, uint32_t clear_mask);
+    
+    // Current level of every pin
+    uint32_t (*read_levels)(void);
+    
+    // Optional inputs: pins pulled low that report each debounced rising
+    // edge. Each call requests one group of pins with its own descriptor,
+    // so different threads can wait on different groups. configure_inputs
+    // returns the group number, or -1 after printing an error; backends
+    // without inputs leave all three NULL.
+    int (*configure_inputs)(const unsigned int *pins, int count, unsigned int debounce_us);
+    
+    // Descriptor that polls readable while the group has events, or -1
+    int (*input_fd)(int group);
+    
+    // Fetch up to max pending events without blocking. Returns the count.
+    int (*read_inputs)(int group, struct gpio_input_event *events, int max);
+    
+    // Release the device
+    void (*close)(void);
+};
+
+extern const struct gpio_backend gpio_mmap_backend;
+extern const struct gpio_backend gpio_rp1_backend;
+extern const struct gpio_backend gpio_gpiod_backend;
+extern const struct gpio_backend gpio_sim_backend;
+
+// Backends built into this program, NULL-terminated
+extern const struct gpio_backend *const gpio_backends[];
+
+// The selected backend
+extern const struct gpio_backend *gpio_backend;
+
+// Select a backend by name, or the first one built in if name is NULL
+// Returns 0 on success, -1 after printing an error.
+int gpio_backend_select(const char *name);
+
+#if defined(GPIO_BACKEND_STATIC_MMAP)
+
+#include "gpio_mmap.h"
+static inline void gpio_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_mmap_apply(set_mask, clear_mask);
+}
+static inline uint32_t gpio_read_levels(void) {
+    return gpio_mmap_read_levels();
+}
+
+#elif defined(GPIO_BACKEND_STATIC_RP1)
+
+#include "gpio_rp1.h"
+static inline void gpio_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_rp1_apply(set_mask, clear_mask);
+}
+static inline uint32_t gpio_read_levels(void) {
+    return gpio_rp1_read_levels();
+}
+
+#elif defined(GPIO_BACKEND_STATIC_GPIOD)
+
+#include "gpio_gpiod.h"
+static inline void gpio_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_gpiod_apply(set_mask, clear_mask);
+}
+static inline uint32_t gpio_read_levels(void) {
+    return gpio_gpiod_read_levels();
+}
+
+#elif defined(GPIO_BACKEND_STATIC_SIM)
+
+#include "gpio_sim.h"
+static inline void gpio_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_sim_apply(set_mask, clear_mask);
+}
+static inline uint32_t gpio_read_levels(void) {
+    return gpio_sim_read_levels();
+}
+
+#else
+
+static inline void gpio_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_backend->apply(set_mask, clear_mask);
+}
+static inline uint32_t gpio_read_levels(void) {
+    return gpio_backend->read_levels();
+}
+
+#endif
+
+// Write a transition across banks: one store to the native pins, then one
+// transfer to each expander it touches
+static inline void gpio_apply_banks(const struct gpio_mask *set_mask, const struct gpio_mask *clear_mask) {
+    gpio_apply(set_mask->bank[0], clear_mask->bank[0]);
+    for (int b = 1; b < GPIO_BANKS; b++) {
+        if (set_mask->bank[b] | clear_mask->bank[b]) expander_apply(b, set_mask->bank[b], clear_mask->bank[b]);
+    }
+}
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * I/O expander output banks
+ * See gpio_expander.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include <linux/spi/spidev.h>
+#include "gpio_expander.h"
+
+// MCP23x17 registers with IOCON.BANK = 0, the power-on default: each
+// A register is followed by its B register, and the address increments
+#define MCP_IODIRA      0x00
+#define MCP_IOCON       0x0a
+#define MCP_OLATA       0x14
+#define MCP_IOCON_HAEN  0x08    // MCP23S17: match the hardware address pins
+#define MCP_SPI_WRITE   0x40    // MCP23S17 opcode, | address << 1
+
+enum expander_type {
+    EXPANDER_NONE,
+    EXPANDER_MCP23017,
+    EXPANDER_MCP23S17,
+};
+
+struct expander {
+    enum expander_type type;
+    char dev[64];
+    unsigned int addr;      // I2C address, or MCP23S17 hardware address
+    int fd;
+    uint32_t latch;         // What the output latch holds
+};
+
+// Indexed by bank; bank 0 is the native GPIOs
+static struct expander expanders[GPIO_BANKS];
+static int simulate;
+static uint64_t errors;
+
+void expander_simulate(void) {
+    simulate = 1;
+}
+
+// Write count registers from reg on, in one transfer
+static int write_regs(const struct expander *e, uint8_t reg, const uint8_t *data, int count) {
+    uint8_t buf[4];
+    int len = 0;
+    
+    if (simulate) return 0;
+    if (e->type == EXPANDER_MCP23S17) buf[len++] = MCP_SPI_WRITE | e->addr << 1;
+    buf[len++] = reg;
+    memcpy(buf + len, data, count);
+    len += count;
+    return write(e->fd, buf, len) == len ? 0 : -1;
+}
+
+// "expander <bank> mcp23017|mcp23s17 <device> <address>"
+static int parse_expander(char *args) {
+    char *save, *bank, *type, *dev, *addr, *end;
+    struct expander *e;
+    long b, a;
+    
+    bank = strtok_r(args, " \t", &save);
+    type = strtok_r(NULL, " \t", &save);
+    dev = strtok_r(NULL, " \t", &save);
+    addr = strtok_r(NULL, " \t", &save);
+    if (!addr || strtok_r(NULL, " \t", &save) || strlen(dev) >= sizeof(e->dev)) return -1;
+    
+    b = strtol(bank, &end, 10);
+    if (*end != '\0' || b < 1 || b >= GPIO_BANKS || expanders[b].type != EXPANDER_NONE) return -1;
+    e = &expanders[b];
+    a = strtol(addr, &end, 0);
+    if (*end != '\0') return -1;
+    
+    if (strcmp(type, "mcp23017") == 0 && a >= 0x08 && a <= 0x77) {
+        e->type = EXPANDER_MCP23017;
+    } else if (strcmp(type, "mcp23s17") == 0 && a >= 0 && a <= 7) {
+        e->type = EXPANDER_MCP23S17;
+    } else {
+        return -1;
+    }
+    snprintf(e->dev, sizeof(e->dev), "%s", dev);
+    e->addr = (unsigned int)a;
+    return 0;
+}
+
+int expander_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    int count = 0, line_no = 0;
+    
+    memset(expanders, 0, sizeof(expanders));
+    for (int b = 0; b < GPIO_BANKS; b++) expanders[b].fd = -1;
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    
+    // Everything else is left to intersections_load() and schedule_load()
+    while (fgets(line, sizeof(line), fp)) {
+        char *save, *key, *args;
+    
+        line_no++;
+        line[strcspn(line, "#\n")] = '\0';
+        key = strtok_r(line, " \t", &save);
+        if (!key || strcmp(key, "expander") != 0) continue;
+        args = strtok_r(NULL, "", &save);
+        if (!args) args = "";
+    
+        if (parse_expander(args) != 0) {
+            fprintf(stderr, "%s:%d: expected a new bank (1-%d), mcp23017 or mcp23s17, a device "
+                    "and an address (I2C 0x08-0x77, SPI 0-7)\n", path, line_no, GPIO_BANKS - 1);
+            fclose(fp);
+            return -1;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int open_expander(struct expander *e, int bank) {
+    uint8_t mode = SPI_MODE_0;
+    uint32_t hz = EXPANDER_SPI_HZ;
+    int err;
+    
+    e->fd = open(e->dev, O_RDWR | O_CLOEXEC);
+    if (e->fd < 0) {
+        fprintf(stderr, "Cannot open expander on bank %d (%s): %s\n", bank, e->dev, strerror(errno));
+        return -1;
+    }
+    if (e->type == EXPANDER_MCP23017) {
+        err = ioctl(e->fd, I2C_SLAVE, e->addr);
+    } else {
+        err = ioctl(e->fd, SPI_IOC_WR_MODE, &mode);
+        if (err == 0) err = ioctl(e->fd, SPI_IOC_WR_MAX_SPEED_HZ, &hz);
+    }
+    if (err < 0) {
+        fprintf(stderr, "Cannot set up expander on bank %d (%s): %s\n", bank, e->dev, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int expander_configure_outputs(const struct gpio_mask *outputs) {
+    for (int b = 1; b < GPIO_BANKS; b++) {
+        struct expander *e = &expanders[b];
+        uint32_t pins = outputs->bank[b];
+        uint8_t zero[2] = { 0, 0 };
+        uint8_t iocon = MCP_IOCON_HAEN;
+        uint8_t iodir[2] = { (uint8_t)~pins, (uint8_t)~(pins >> 8) };   // 1 = input
+    
+        if (!pins) continue;
+        if (e->type == EXPANDER_NONE) {
+            fprintf(stderr, "GPIO %d is on bank %d, which has no expander line\n",
+                    b * GPIO_BANK_PINS + __builtin_ctz(pins), b);
+            return -1;
+        }
+        if (pins >> EXPANDER_PINS) {
+            fprintf(stderr, "GPIO %d: the expander on bank %d has pins %d-%d\n",
+                    b * GPIO_BANK_PINS + 31 - __builtin_clz(pins), b,
+                    b * GPIO_BANK_PINS, b * GPIO_BANK_PINS + EXPANDER_PINS - 1);
+            return -1;
+        }
+        if (!simulate && open_expander(e, b) != 0) return -1;
+    
+        // Latch low before the pins become outputs, so nothing flashes on
+        e->latch = 0;
+        if ((e->type == EXPANDER_MCP23S17 && write_regs(e, MCP_IOCON, &iocon, 1) != 0) ||
+            write_regs(e, MCP_OLATA, zero, 2) != 0 || write_regs(e, MCP_IODIRA, iodir, 2) != 0) {
+            fprintf(stderr, "Cannot write expander on bank %d (%s): %s\n", b, e->dev, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void expander_apply(int bank, uint32_t set_mask, uint32_t clear_mask) {
+    struct expander *e = &expanders[bank];
+    uint32_t latch = (e->latch | set_mask) & ~clear_mask;
+    uint8_t olat[2] = { (uint8_t)latch, (uint8_t)(latch >> 8) };
+    
+    // The copy only changes once the chip has it, so a failed transfer
+    // is tried again by the next apply
+    if (latch == e->latch) return;
+    if (write_regs(e, MCP_OLATA, olat, 2) != 0) errors++;
+    else e->latch = latch;
+}
+
+uint64_t expander_errors(void) {
+    return errors;
+}
+
+void expander_close(void) {
+    for (int b = 1; b < GPIO_BANKS; b++) {
+        if (expanders[b].type != EXPANDER_NONE && expanders[b].fd >= 0) close(expanders[b].fd);
+        expanders[b].fd = -1;
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * I/O expander output banks
+ *
+ * Heads beyond the SoC's GPIOs (turn arrows, pedestrian heads, a fourth
+ * approach) can be wired to 16-pin MCP23017 (I2C) or MCP23S17 (SPI)
+ * expanders, one per bank, declared anywhere in the config file:
+ *
+ *   expander 1 mcp23017 /dev/i2c-1 0x20        # pins 32-47
+ *   expander 2 mcp23s17 /dev/spidev0.0 0       # pins 64-79, hardware address 0
+ *
+ * Each expander keeps a copy of its output latch, and a write to a bank
+ * sends the whole new latch (ports A and B) in one bus transfer, so a
+ * phase change costs one transfer per expander it touches, after the
+ * single store to the native pins. A transfer takes tens of microseconds,
+ * so expander heads change that much after the native ones: keep the
+ * standard heads on native GPIOs.
+ */
+
+#ifndef GPIO_EXPANDER_H
+#define GPIO_EXPANDER_H
+
+#include <stdint.h>
+#include "gpio_mask.h"
+
+#define EXPANDER_PINS       16                  // Ports A and B
+#define EXPANDER_SPI_HZ     10000000            // MCP23S17 maximum
+
+// Read the expander lines of a config file
+// Returns the number of expanders (0 if there are none), or -1 after
+// printing an error.
+int expander_load(const char *path);
+
+// Don't open the expanders; keep their latches in memory only
+void expander_simulate(void);
+
+// Open the expanders that banks 1-3 of outputs need and make those pins
+// outputs, driven low. Returns 0, or -1 after printing an error if a pin
+// has no expander.
+int expander_configure_outputs(const struct gpio_mask *outputs);
+
+// Drive set_mask pins of a bank high and clear_mask pins low, in one
+// transfer if the latch changes. After a failed transfer the next call
+// sends the latch again.
+void expander_apply(int bank, uint32_t set_mask, uint32_t clear_mask);
+
+// Transfers that failed since the expanders were opened
+uint64_t expander_errors(void);
+
+// Close the devices
+void expander_close(void);
+
+#endif
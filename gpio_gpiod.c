@@ -0,0 +1,292 @@
+/*
+ * libgpiod v2 GPIO backend
+ * See gpio_gpiod.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <gpiod.h>
+#include "gpio_backend.h"
+#include "gpio_gpiod.h"
+
+#define MAX_LINES   32
+
+static struct gpiod_chip *chip;
+static struct gpiod_line_request *request;
+static int num_inputs;      // Input groups requested so far
+static struct gpiod_line_request *inputs[MAX_INPUT_GROUPS];
+static struct gpiod_edge_event_buffer *event_buffers[MAX_INPUT_GROUPS];
+static unsigned int offsets[MAX_LINES];
+static enum gpiod_line_value values[MAX_LINES];
+static int num_lines;
+static uint32_t level;      // Current output level of every pin
+
+// Check that path is the chip driving the header pins and open it
+static struct gpiod_chip *open_labelled(const char *path) {
+    struct gpiod_chip *c = gpiod_chip_open(path);
+    struct gpiod_chip_info *info;
+    int match;
+    
+    if (!c) return NULL;
+    info = gpiod_chip_get_info(c);
+    match = info && strcmp(gpiod_chip_info_get_label(info), GPIOD_CHIP_LABEL) == 0;
+    if (info) gpiod_chip_info_free(info);
+    
+    if (!match) {
+        gpiod_chip_close(c);
+        return NULL;
+    }
+    return c;
+}
+
+static int read_cache(char *path, size_t size) {
+    FILE *fp = fopen(GPIOD_CHIP_CACHE, "r");
+    int ok;
+    
+    if (!fp) return -1;
+    ok = fgets(path, size, fp) != NULL;
+    fclose(fp);
+    if (!ok) return -1;
+    path[strcspn(path, "\n")] = '\0';
+    return 0;
+}
+
+// Best effort: without write access the next start just scans again
+static void write_cache(const char *path) {
+    FILE *fp = fopen(GPIOD_CHIP_CACHE ".tmp", "w");
+    
+    if (!fp) return;
+    if (fprintf(fp, "%s\n", path) < 0 || fclose(fp) != 0) {
+        unlink(GPIOD_CHIP_CACHE ".tmp");
+        return;
+    }
+    rename(GPIOD_CHIP_CACHE ".tmp", GPIOD_CHIP_CACHE);
+}
+
+struct gpiod_chip *gpio_gpiod_open_chip(void) {
+    const char *fallback_paths[] = {
+        "/dev/gpiochip0",
+        "/dev/gpiochip4",
+        NULL
+    };
+    struct gpiod_chip *c = NULL;
+    struct dirent *ent;
+    char path[300];
+    DIR *dir;
+    
+    // Last boot's answer, if it still has the right label
+    if (read_cache(path, sizeof(path)) == 0 && (c = open_labelled(path))) goto found;
+    
+    // The chip number differs between kernels, the label doesn't
+    dir = opendir("/dev");
+    while (dir && !c && (ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "gpiochip", 8) != 0) continue;
+        snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+        c = open_labelled(path);
+    }
+    if (dir) closedir(dir);
+    if (c) {
+        write_cache(path);
+        goto found;
+    }
+    
+    // Kernels with another label: the paths we have seen on a Pi 5
+    for (int i = 0; fallback_paths[i] != NULL && !c; i++) {
+        snprintf(path, sizeof(path), "%s", fallback_paths[i]);
+        c = gpiod_chip_open(path);
+    }
+    if (!c) return NULL;
+    
+found:
+    printf("Using GPIO chip: %s\n", path);
+    return c;
+}
+
+static int gpiod_backend_init(void) {
+    chip = gpio_gpiod_open_chip();
+    if (!chip) {
+        fprintf(stderr, "Failed to open any GPIO chip!\n");
+        fprintf(stderr, "Available chips: ls /dev/gpio*\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int gpiod_backend_configure_outputs(const unsigned int *pins, int count) {
+    struct gpiod_line_settings *settings = NULL;
+    struct gpiod_line_config *line_cfg = NULL;
+    struct gpiod_request_config *req_cfg = NULL;
+    
+    if (count > MAX_LINES) {
+        fprintf(stderr, "Too many output lines (%d, max %d)\n", count, MAX_LINES);
+        return -1;
+    }
+    
+    settings = gpiod_line_settings_new();
+    line_cfg = gpiod_line_config_new();
+    req_cfg = gpiod_request_config_new();
+    if (!settings || !line_cfg || !req_cfg) {
+        fprintf(stderr, "Failed to allocate GPIO line configuration\n");
+        goto fail;
+    }
+    
+    // Output, initially low
+    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT);
+    gpiod_line_settings_set_output_value(settings, GPIOD_LINE_VALUE_INACTIVE);
+    
+    // Add lines one at a time so request order matches pins[]
+    for (int i = 0; i < count; i++) {
+        offsets[i] = pins[i];
+        values[i] = GPIOD_LINE_VALUE_INACTIVE;
+        gpiod_line_config_add_line_settings(line_cfg, &offsets[i], 1, settings);
+    }
+    num_lines = count;
+    level = 0;
+    
+    gpiod_request_config_set_consumer(req_cfg, "stoplight");
+    request = gpiod_chip_request_lines(chip, req_cfg, line_cfg);
+    if (!request) {
+        perror("Failed to request GPIO lines");
+        goto fail;
+    }
+    
+    gpiod_request_config_free(req_cfg);
+    gpiod_line_config_free(line_cfg);
+    gpiod_line_settings_free(settings);
+    return 0;
+    
+fail:
+    if (req_cfg) gpiod_request_config_free(req_cfg);
+    if (line_cfg) gpiod_line_config_free(line_cfg);
+    if (settings) gpiod_line_settings_free(settings);
+    return -1;
+}
+
+void gpio_gpiod_apply(uint32_t set_mask, uint32_t clear_mask) {
+    level = (level | set_mask) & ~clear_mask;
+    
+    for (int i = 0; i < num_lines; i++) {
+        values[i] = (level >> offsets[i]) & 1 ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+    }
+    gpiod_line_request_set_values(request, values);
+}
+
+uint32_t gpio_gpiod_read_levels(void) {
+    enum gpiod_line_value read[MAX_LINES];
+    uint32_t levels = 0;
+    
+    if (gpiod_line_request_get_values(request, read) != 0) return 0;
+    for (int i = 0; i < num_lines; i++) {
+        if (read[i] == GPIOD_LINE_VALUE_ACTIVE) levels |= 1u << offsets[i];
+    }
+    return levels;
+}
+
+// Each group is one line request, so its edges arrive on a single fd
+static int gpiod_backend_configure_inputs(const unsigned int *pins, int count,
+                                          unsigned int debounce_us) {
+    struct gpiod_line_settings *settings = NULL;
+    struct gpiod_line_config *line_cfg = NULL;
+    struct gpiod_request_config *req_cfg = NULL;
+    int group = num_inputs, ret = -1;
+    
+    if (group == MAX_INPUT_GROUPS) {
+        fprintf(stderr, "Too many input groups (max %d)\n", MAX_INPUT_GROUPS);
+        return -1;
+    }
+    
+    settings = gpiod_line_settings_new();
+    line_cfg = gpiod_line_config_new();
+    req_cfg = gpiod_request_config_new();
+    event_buffers[group] = gpiod_edge_event_buffer_new(MAX_LINES);
+    if (!settings || !line_cfg || !req_cfg || !event_buffers[group]) {
+        fprintf(stderr, "Failed to allocate GPIO line configuration\n");
+        goto out;
+    }
+    
+    // Input to 3.3V: idle low, an event is a rising edge. The kernel
+    // debounces and timestamps each edge on CLOCK_MONOTONIC.
+    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_INPUT);
+    gpiod_line_settings_set_bias(settings, GPIOD_LINE_BIAS_PULL_DOWN);
+    gpiod_line_settings_set_edge_detection(settings, GPIOD_LINE_EDGE_RISING);
+    gpiod_line_settings_set_debounce_period_us(settings, debounce_us);
+    gpiod_line_settings_set_event_clock(settings, GPIOD_LINE_CLOCK_MONOTONIC);
+    
+    if (gpiod_line_config_add_line_settings(line_cfg, pins, count, settings) != 0) {
+        perror("Failed to configure GPIO input lines");
+        goto out;
+    }
+    
+    gpiod_request_config_set_consumer(req_cfg, "stoplight");
+    inputs[group] = gpiod_chip_request_lines(chip, req_cfg, line_cfg);
+    if (!inputs[group]) {
+        perror("Failed to request GPIO input lines");
+        goto out;
+    }
+    num_inputs++;
+    ret = group;
+    
+out:
+    if (req_cfg) gpiod_request_config_free(req_cfg);
+    if (line_cfg) gpiod_line_config_free(line_cfg);
+    if (settings) gpiod_line_settings_free(settings);
+    return ret;
+}
+
+static int gpiod_backend_input_fd(int group) {
+    return group >= 0 && group < num_inputs ? gpiod_line_request_get_fd(inputs[group]) : -1;
+}
+
+static int gpiod_backend_read_inputs(int group, struct gpio_input_event *events, int max) {
+    int count;
+    
+    // Reading blocks when nothing is queued, so check first
+    if (group < 0 || group >= num_inputs) return 0;
+    if (gpiod_line_request_wait_edge_events(inputs[group], 0) <= 0) return 0;
+    if (max > MAX_LINES) max = MAX_LINES;
+    
+    count = gpiod_line_request_read_edge_events(inputs[group], event_buffers[group], max);
+    for (int i = 0; i < count; i++) {
+        struct gpiod_edge_event *ev = gpiod_edge_event_buffer_get_event(event_buffers[group], i);
+        
+        events[i].time_ns = gpiod_edge_event_get_timestamp_ns(ev);
+        events[i].pin = gpiod_edge_event_get_line_offset(ev);
+    }
+    return count < 0 ? 0 : count;
+}
+
+static void gpiod_backend_close(void) {
+    for (int i = 0; i < MAX_INPUT_GROUPS; i++) {
+        if (inputs[i]) {
+            gpiod_line_request_release(inputs[i]);
+            inputs[i] = NULL;
+        }
+        if (event_buffers[i]) {
+            gpiod_edge_event_buffer_free(event_buffers[i]);
+            event_buffers[i] = NULL;
+        }
+    }
+    num_inputs = 0;
+    if (request) {
+        gpiod_line_request_release(request);
+        request = NULL;
+    }
+    if (chip) {
+        gpiod_chip_close(chip);
+        chip = NULL;
+    }
+}
+
+const struct gpio_backend gpio_gpiod_backend = {
+    .name = "gpiod",
+    .init = gpiod_backend_init,
+    .configure_outputs = gpiod_backend_configure_outputs,
+    .apply = gpio_gpiod_apply,
+    .read_levels = gpio_gpiod_read_levels,
+    .configure_inputs = gpiod_backend_configure_inputs,
+    .input_fd = gpiod_backend_input_fd,
+    .read_inputs = gpiod_backend_read_inputs,
+    .close = gpiod_backend_close,
+};
@@ -0,0 +1,33 @@
+/*
+ * libgpiod v2 GPIO backend
+ *
+ * Every output pin is held in one line request, so any number of head
+ * changes is written with a single set_values ioctl.
+ *
+ * The chip is found by its label rather than its number, which changes
+ * between kernels. The path found is cached so later starts open it
+ * straight away.
+ */
+
+#ifndef GPIO_GPIOD_H
+#define GPIO_GPIOD_H
+
+#include <stdint.h>
+
+#define GPIOD_CHIP_LABEL    "pinctrl-rp1"                   // Pi 5 header pins
+#define GPIOD_CHIP_CACHE    "/var/cache/stoplight-gpiochip"
+
+struct gpiod_chip;
+
+// Open the chip with GPIOD_CHIP_LABEL: the cached path if it still
+// matches, else the first /dev/gpiochip* with that label, else a known
+// Pi 5 path. Returns NULL if none opens.
+struct gpiod_chip *gpio_gpiod_open_chip(void);
+
+// Drive set_mask pins high and clear_mask pins low in one kernel call
+void gpio_gpiod_apply(uint32_t set_mask, uint32_t clear_mask);
+
+// Read back the level of every requested pin in one kernel call
+uint32_t gpio_gpiod_read_levels(void);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Output pin masks spanning several banks
+ *
+ * Bank 0 is the SoC's own GPIOs, written through the GPIO backend; banks
+ * 1-3 are I/O expanders (see gpio_expander.h). Output pin numbers run on
+ * across the banks, 32 to a bank: pin 32 * b + n is bit n of bank b, so
+ * GPIO 0-31 keep their numbers and pin 37 is the expander on bank 1, pin 5.
+ */
+
+#ifndef GPIO_MASK_H
+#define GPIO_MASK_H
+
+#include <stdint.h>
+
+#define GPIO_BANKS          4
+#define GPIO_BANK_PINS      32
+#define MAX_GPIO            (GPIO_BANKS * GPIO_BANK_PINS)
+
+struct gpio_mask {
+    uint32_t bank[GPIO_BANKS];
+};
+
+static inline void gpio_mask_add(struct gpio_mask *mask, unsigned int pin) {
+    mask->bank[pin / GPIO_BANK_PINS] |= 1u << (pin % GPIO_BANK_PINS);
+}
+
+static inline int gpio_mask_has(const struct gpio_mask *mask, unsigned int pin) {
+    return (mask->bank[pin / GPIO_BANK_PINS] >> (pin % GPIO_BANK_PINS)) & 1;
+}
+
+static inline void gpio_mask_or(struct gpio_mask *mask, const struct gpio_mask *other) {
+    for (int b = 0; b < GPIO_BANKS; b++) mask->bank[b] |= other->bank[b];
+}
+
+static inline int gpio_mask_count(const struct gpio_mask *mask) {
+    int count = 0;
+    
+    for (int b = 0; b < GPIO_BANKS; b++) count += __builtin_popcount(mask->bank[b]);
+    return count;
+}
+
+static inline int gpio_mask_overlaps(const struct gpio_mask *a, const struct gpio_mask *b) {
+    uint32_t common = 0;
+    
+    for (int i = 0; i < GPIO_BANKS; i++) common |= a->bank[i] & b->bank[i];
+    return common != 0;
+}
+
+#endif
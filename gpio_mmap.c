@@ -0,0 +1,167 @@
+/*
+ * Memory-mapped GPIO register backend
+ * See gpio_mmap.h
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "gpio_backend.h"
+#include "gpio_mmap.h"
+
+volatile uint32_t *gpio;
+
+// Set GPIO pin as output using inline ARM assembly
+void gpio_set_output(int pin) {
+    uint32_t reg_offset = pin / 10;
+    uint32_t bit_offset = (pin % 10) * 3;
+    uint32_t value, mask, output_bits;
+    
+    // Load current register value
+    __asm__ volatile (
+        "ldr %w[value], [%[gpio_reg], %[offset], lsl #2]"
+        : [value] "=r" (value)
+        : [gpio_reg] "r" (gpio), [offset] "r" (reg_offset)
+        : "memory"
+    );
+    
+    // Clear the 3 bits for this pin
+    mask = 0b111 << bit_offset;
+    __asm__ volatile (
+        "bic %w[value], %w[value], %w[mask]"
+        : [value] "+r" (value)
+        : [mask] "r" (mask)
+    );
+    
+    // Set bit pattern for output (001)
+    output_bits = 0b001 << bit_offset;
+    __asm__ volatile (
+        "orr %w[value], %w[value], %w[bits]"
+        : [value] "+r" (value)
+        : [bits] "r" (output_bits)
+    );
+    
+    // Write back to register
+    __asm__ volatile (
+        "str %w[value], [%[gpio_reg], %[offset], lsl #2]"
+        :
+        : [value] "r" (value), [gpio_reg] "r" (gpio), [offset] "r" (reg_offset)
+        : "memory"
+    );
+}
+
+// Set many GPIO pins as outputs with one read-modify-write per GPFSEL register
+void gpio_set_outputs(uint32_t pin_mask) {
+    uint32_t clear[NUM_GPFSEL] = { 0 }, set[NUM_GPFSEL] = { 0 };
+    
+    // Work out the final function bits of each register first
+    for (int pin = 0; pin < 32; pin++) {
+        if (!(pin_mask & (1u << pin))) continue;
+        clear[pin / 10] |= 0b111u << ((pin % 10) * 3);
+        set[pin / 10] |= 0b001u << ((pin % 10) * 3);
+    }
+    
+    for (uint32_t reg = GPFSEL0; reg < NUM_GPFSEL; reg++) {
+        uint32_t value;
+        
+        if (!clear[reg]) continue;
+        
+        __asm__ volatile (
+            "ldr %w[value], [%[gpio_reg], %[offset], lsl #2]"
+            : [value] "=r" (value)
+            : [gpio_reg] "r" (gpio), [offset] "r" (reg)
+            : "memory"
+        );
+        value = (value & ~clear[reg]) | set[reg];
+        __asm__ volatile (
+            "str %w[value], [%[gpio_reg], %[offset], lsl #2]"
+            :
+            : [value] "r" (value), [gpio_reg] "r" (gpio), [offset] "r" (reg)
+            : "memory"
+        );
+    }
+}
+
+// Set GPIO pin HIGH using ARM assembly
+void gpio_set_high(int pin) {
+    uint32_t bit_mask = 1 << pin;
+    
+    __asm__ volatile (
+        "str %w[mask], [%[gpio_reg], %[offset], lsl #2]"
+        :
+        : [mask] "r" (bit_mask), [gpio_reg] "r" (gpio), [offset] "r" (GPSET0)
+        : "memory"
+    );
+}
+
+// Set GPIO pin LOW using ARM assembly
+void gpio_set_low(int pin) {
+    uint32_t bit_mask = 1 << pin;
+    
+    __asm__ volatile (
+        "str %w[mask], [%[gpio_reg], %[offset], lsl #2]"
+        :
+        : [mask] "r" (bit_mask), [gpio_reg] "r" (gpio), [offset] "r" (GPCLR0)
+        : "memory"
+    );
+}
+
+static int mmap_init(void) {
+    int mem_fd;
+    void *gpio_map;
+    
+    // Open /dev/mem (requires root)
+    if ((mem_fd = open("/dev/mem", O_RDWR|O_SYNC)) < 0) {
+        perror("Cannot open /dev/mem");
+        printf("Try running with sudo!\n");
+        return -1;
+    }
+    
+    // Map GPIO memory
+    gpio_map = mmap(NULL, BLOCK_SIZE, PROT_READ|PROT_WRITE, 
+                    MAP_SHARED, mem_fd, GPIO_BASE);
+    close(mem_fd);
+    
+    if (gpio_map == MAP_FAILED) {
+        perror("mmap error");
+        return -1;
+    }
+    
+    gpio = (volatile uint32_t *)gpio_map;
+    return 0;
+}
+
+static int mmap_configure_outputs(const unsigned int *pins, int count) {
+    uint32_t mask = 0;
+    
+    for (int i = 0; i < count; i++) mask |= 1u << pins[i];
+    gpio_set_outputs(mask);
+    gpio_clear_multiple(mask);
+    return 0;
+}
+
+static void mmap_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_mmap_apply(set_mask, clear_mask);
+}
+
+static uint32_t mmap_read_levels(void) {
+    return gpio_mmap_read_levels();
+}
+
+static void mmap_close(void) {
+    if (gpio) {
+        munmap((void *)gpio, BLOCK_SIZE);
+        gpio = NULL;
+    }
+}
+
+const struct gpio_backend gpio_mmap_backend = {
+    .name = "mmap",
+    .concurrent_apply = 1,
+    .init = mmap_init,
+    .configure_outputs = mmap_configure_outputs,
+    .apply = mmap_apply,
+    .read_levels = mmap_read_levels,
+    .close = mmap_close,
+};
@@ -0,0 +1,83 @@
+/*
+ * Memory-mapped GPIO register backend (BCM-style GPSET0/GPCLR0)
+ *
+ * Registers are mapped from /dev/mem and written with inline AArch64
+ * assembly. The hot-path stores are inline so a compile-time bound
+ * controller reduces a phase change to two STR instructions.
+ */
+
+#ifndef GPIO_MMAP_H
+#define GPIO_MMAP_H
+
+#include <stdint.h>
+
+// BCM2712 (Raspberry Pi 5) GPIO registers
+#define BCM2712_PERI_BASE   0x1f00000000
+#define GPIO_BASE           (BCM2712_PERI_BASE + 0xd0000)
+#define PAGE_SIZE           (4*1024)
+#define BLOCK_SIZE          (4*1024)
+
+// GPIO register offsets
+#define GPFSEL0     0
+#define GPFSEL1     1
+#define GPFSEL2     2
+#define GPFSEL3     3
+#define NUM_GPFSEL  4       // Enough for GPIO 0-31, ten pins per register
+#define GPSET0      7
+#define GPCLR0      10
+#define GPLEV0      13
+
+// Mapped GPIO registers
+extern volatile uint32_t *gpio;
+
+// Set GPIO pin as output using inline ARM assembly
+void gpio_set_output(int pin);
+
+// Set every pin in pin_mask as output, reading and writing each function
+// select register that holds one of them exactly once
+void gpio_set_outputs(uint32_t pin_mask);
+
+// Set GPIO pin HIGH / LOW using ARM assembly
+void gpio_set_high(int pin);
+void gpio_set_low(int pin);
+
+// Set multiple GPIO pins using ARM assembly (efficient batch operation)
+static inline void gpio_set_multiple(uint32_t pin_mask) {
+    __asm__ volatile (
+        "str %w[mask], [%[gpio_reg], %[offset], lsl #2]"
+        :
+        : [mask] "r" (pin_mask), [gpio_reg] "r" (gpio), [offset] "r" (GPSET0)
+        : "memory"
+    );
+}
+
+// Clear multiple GPIO pins using ARM assembly
+static inline void gpio_clear_multiple(uint32_t pin_mask) {
+    __asm__ volatile (
+        "str %w[mask], [%[gpio_reg], %[offset], lsl #2]"
+        :
+        : [mask] "r" (pin_mask), [gpio_reg] "r" (gpio), [offset] "r" (GPCLR0)
+        : "memory"
+    );
+}
+
+// New heads go on before old ones go off, so no phase change is dark
+static inline void gpio_mmap_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_set_multiple(set_mask);
+    gpio_clear_multiple(clear_mask);
+}
+
+// Read the level of GPIO 0-31
+static inline uint32_t gpio_mmap_read_levels(void) {
+    uint32_t levels;
+    
+    __asm__ volatile (
+        "ldr %w[levels], [%[gpio_reg], %[offset], lsl #2]"
+        : [levels] "=r" (levels)
+        : [gpio_reg] "r" (gpio), [offset] "r" (GPLEV0)
+        : "memory"
+    );
+    return levels;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Native RP1 GPIO backend for the Raspberry Pi 5
+ * See gpio_rp1.h
+ */
+
+// RP1_GPIO_PHYS is above 4 GB, beyond a 32-bit off_t on a 32-bit OS
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "gpio_backend.h"
+#include "gpio_rp1.h"
+
+volatile uint8_t *rp1;
+
+_Static_assert(sizeof(off_t) == 8, "the /dev/mem offset of RP1 needs a 64-bit off_t");
+
+// /dev/gpiomem0 exposes exactly bank 0; /dev/mem needs root and the address
+static int rp1_init(void) {
+    void *map = MAP_FAILED;
+    int fd;
+    
+    fd = open("/dev/gpiomem0", O_RDWR | O_SYNC);
+    if (fd >= 0) {
+        map = mmap(NULL, RP1_GPIO_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if (map == MAP_FAILED) {
+        fd = open("/dev/mem", O_RDWR | O_SYNC);
+        if (fd < 0) {
+            perror("Cannot open /dev/gpiomem0 or /dev/mem");
+            printf("Is this a Raspberry Pi 5? Otherwise try running with sudo!\n");
+            return -1;
+        }
+        map = mmap(NULL, RP1_GPIO_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, RP1_GPIO_PHYS);
+        close(fd);
+    }
+    if (map == MAP_FAILED) {
+        perror("mmap error");
+        return -1;
+    }
+    
+    rp1 = map;
+    return 0;
+}
+
+static int rp1_configure_outputs(const unsigned int *pins, int count) {
+    uint32_t mask = 0;
+    
+    for (int i = 0; i < count; i++) {
+        if (pins[i] >= RP1_NUM_GPIOS) {
+            fprintf(stderr, "GPIO %u is not on RP1 bank 0 (0-%d)\n", pins[i], RP1_NUM_GPIOS - 1);
+            return -1;
+        }
+        mask |= 1u << pins[i];
+    }
+    
+    // Start low, then enable the drivers before handing the pins to RIO
+    *rp1_reg(RP1_SYS_RIO0 + RP1_ALIAS_CLR + RP1_RIO_OUT) = mask;
+    *rp1_reg(RP1_SYS_RIO0 + RP1_ALIAS_SET + RP1_RIO_OE) = mask;
+    for (int i = 0; i < count; i++) {
+        volatile uint32_t *pad = rp1_reg(RP1_PADS_BANK0 + RP1_PADS_GPIO(pins[i]));
+        volatile uint32_t *ctrl = rp1_reg(RP1_IO_BANK0 + RP1_GPIO_CTRL(pins[i]));
+        
+        *pad = (*pad & ~RP1_PADS_OD) | RP1_PADS_IE;
+        *ctrl = (*ctrl & ~RP1_CTRL_FUNCSEL) | RP1_FUNCSEL_RIO;
+    }
+    return 0;
+}
+
+static void rp1_apply(uint32_t set_mask, uint32_t clear_mask) {
+    gpio_rp1_apply(set_mask, clear_mask);
+}
+
+static uint32_t rp1_read_levels(void) {
+    return gpio_rp1_read_levels();
+}
+
+static void rp1_close(void) {
+    if (rp1) {
+        munmap((void *)rp1, RP1_GPIO_SIZE);
+        rp1 = NULL;
+    }
+}
+
+const struct gpio_backend gpio_rp1_backend = {
+    .name = "rp1",
+    .concurrent_apply = 1,
+    .init = rp1_init,
+    .configure_outputs = rp1_configure_outputs,
+    .apply = rp1_apply,
+    .read_levels = rp1_read_levels,
+    .close = rp1_close,
+};
@@ -0,0 +1,70 @@
+/*
+ * Native RP1 GPIO backend for the Raspberry Pi 5
+ *
+ * On the Pi 5 the header pins belong to the RP1 southbridge, not the
+ * BCM2712. Its bank 0 (GPIO 0-27) is three register blocks, mapped
+ * together from /dev/gpiomem0 (no root needed) or /dev/mem:
+ *
+ *   IO_BANK0   pin function select (funcsel 5 hands the pin to RIO)
+ *   SYS_RIO0   registered I/O: output level, output enable, input level
+ *   PADS_BANK0 pad drive, pulls and input/output enables
+ *
+ * Every RP1 register block has atomic aliases: writing a mask at +0x1000
+ * XORs it into the register, +0x2000 sets those bits and +0x3000 clears
+ * them. A phase change is therefore two plain stores to RIO, with no
+ * read-modify-write and no system call.
+ */
+
+#ifndef GPIO_RP1_H
+#define GPIO_RP1_H
+
+#include <stdint.h>
+
+#define RP1_GPIO_PHYS       0x1f000d0000ULL     // IO_BANK0 seen from the BCM2712
+#define RP1_GPIO_SIZE       0x30000
+#define RP1_NUM_GPIOS       28                  // Bank 0: the 40-pin header
+
+// Block offsets within the mapping
+#define RP1_IO_BANK0        0x00000
+#define RP1_SYS_RIO0        0x10000
+#define RP1_PADS_BANK0      0x20000
+
+// Atomic register aliases
+#define RP1_ALIAS_XOR       0x1000
+#define RP1_ALIAS_SET       0x2000
+#define RP1_ALIAS_CLR       0x3000
+
+// IO_BANK0
+#define RP1_GPIO_CTRL(n)    (0x004 + 8 * (n))
+#define RP1_CTRL_FUNCSEL    0x1f
+#define RP1_FUNCSEL_RIO     5
+
+// SYS_RIO0
+#define RP1_RIO_OUT         0x00
+#define RP1_RIO_OE          0x04
+#define RP1_RIO_SYNC_IN     0x08
+
+// PADS_BANK0
+#define RP1_PADS_GPIO(n)    (0x04 + 4 * (n))
+#define RP1_PADS_OD         (1u << 7)           // Output disable
+#define RP1_PADS_IE         (1u << 6)           // Input enable
+
+// Mapped RP1 bank 0
+extern volatile uint8_t *rp1;
+
+static inline volatile uint32_t *rp1_reg(uint32_t offset) {
+    return (volatile uint32_t *)(rp1 + offset);
+}
+
+// New heads go on before old ones go off, so no phase change is dark
+static inline void gpio_rp1_apply(uint32_t set_mask, uint32_t clear_mask) {
+    *rp1_reg(RP1_SYS_RIO0 + RP1_ALIAS_SET + RP1_RIO_OUT) = set_mask;
+    *rp1_reg(RP1_SYS_RIO0 + RP1_ALIAS_CLR + RP1_RIO_OUT) = clear_mask;
+}
+
+// Read the level of GPIO 0-27
+static inline uint32_t gpio_rp1_read_levels(void) {
+    return *rp1_reg(RP1_SYS_RIO0 + RP1_RIO_SYNC_IN);
+}
+
+#endif
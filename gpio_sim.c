@@ -0,0 +1,94 @@
+/*
+ * Simulated GPIO backend
+ * See gpio_sim.h
+ */
+
+#include <inttypes.h>
+#include "gpio_backend.h"
+#include "gpio_sim.h"
+#include "phase_timer.h"
+
+uint32_t gpio_sim_level;
+static uint32_t output_mask;
+static int num_inputs;      // Input groups handed out
+
+static struct sim_transition history[SIM_HISTORY];
+static uint64_t num_transitions;
+static FILE *trace_fp;
+
+void gpio_sim_apply(uint32_t set_mask, uint32_t clear_mask) {
+    uint32_t level = (gpio_sim_level | set_mask) & ~clear_mask;
+    struct sim_transition *t;
+    
+    if (level == gpio_sim_level) return;
+    gpio_sim_level = level;
+    
+    t = &history[num_transitions++ % SIM_HISTORY];
+    t->time_ns = clock_now_ns();
+    t->level = level;
+    if (trace_fp) fprintf(trace_fp, "%" PRIu64 " %08" PRIx32 "\n", t->time_ns, level);
+}
+
+void gpio_sim_trace(FILE *fp) {
+    trace_fp = fp;
+}
+
+uint64_t gpio_sim_transition_count(void) {
+    return num_transitions;
+}
+
+const struct sim_transition *gpio_sim_transition(uint64_t n) {
+    if (n >= num_transitions || num_transitions - n > SIM_HISTORY) return NULL;
+    return &history[n % SIM_HISTORY];
+}
+
+static int sim_init(void) {
+    gpio_sim_level = 0;
+    output_mask = 0;
+    num_transitions = 0;
+    num_inputs = 0;
+    return 0;
+}
+
+static int sim_configure_outputs(const unsigned int *pins, int count) {
+    for (int i = 0; i < count; i++) output_mask |= 1u << pins[i];
+    gpio_sim_level &= ~output_mask;
+    return 0;
+}
+
+static uint32_t sim_read_levels(void) {
+    return gpio_sim_read_levels();
+}
+
+// Simulated inputs never see an edge
+static int sim_configure_inputs(const unsigned int *pins, int count, unsigned int debounce_us) {
+    if (num_inputs == MAX_INPUT_GROUPS) {
+        fprintf(stderr, "Too many input groups (max %d)\n", MAX_INPUT_GROUPS);
+        return -1;
+    }
+    return num_inputs++;
+}
+
+static int sim_input_fd(int group) {
+    return -1;
+}
+
+static int sim_read_inputs(int group, struct gpio_input_event *events, int max) {
+    return 0;
+}
+
+static void sim_close(void) {
+    if (trace_fp) fflush(trace_fp);
+}
+
+const struct gpio_backend gpio_sim_backend = {
+    .name = "sim",
+    .init = sim_init,
+    .configure_outputs = sim_configure_outputs,
+    .apply = gpio_sim_apply,
+    .read_levels = sim_read_levels,
+    .configure_inputs = sim_configure_inputs,
+    .input_fd = sim_input_fd,
+    .read_inputs = sim_read_inputs,
+    .close = sim_close,
+};
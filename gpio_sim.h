@@ -0,0 +1,44 @@
+/*
+ * Simulated GPIO backend
+ *
+ * Holds pin levels in memory, for running the controller on machines
+ * without GPIO hardware. Every change of the outputs is recorded with the
+ * time it happened (on the virtual clock when that is in use), both in a
+ * ring of recent transitions that can be inspected and, optionally, as
+ * lines "<time_ns> <level>" in a trace file.
+ */
+
+#ifndef GPIO_SIM_H
+#define GPIO_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_HISTORY     4096    // Transitions kept in memory
+
+// One recorded change of the simulated outputs
+struct sim_transition {
+    uint64_t time_ns;       // clock_now_ns() when the levels changed
+    uint32_t level;         // Level of every pin after the change
+};
+
+// Current level of every simulated pin
+extern uint32_t gpio_sim_level;
+
+void gpio_sim_apply(uint32_t set_mask, uint32_t clear_mask);
+
+static inline uint32_t gpio_sim_read_levels(void) {
+    return gpio_sim_level;
+}
+
+// Write every transition from now on to fp (NULL to stop)
+void gpio_sim_trace(FILE *fp);
+
+// Number of transitions recorded since init
+uint64_t gpio_sim_transition_count(void);
+
+// Transition number n (counting from 0), or NULL if it is older than the
+// last SIM_HISTORY transitions or hasn't happened yet
+const struct sim_transition *gpio_sim_transition(uint64_t n);
+
+#endif
@@ -2,8 +2,21 @@
  * GPIO Diagnostic Test for Raspberry Pi 5
  * Tests GPIO access and reports what's happening
  * 
- * Compile: gcc -o gpio_test gpio_test.c
- * Run: sudo ./gpio_test
+ * With --bench, measures how fast each way of driving the pins is instead:
+ * toggles per second and per-write latency percentiles for raw register
+ * stores, libgpiod single-line and batched writes, and a full phase change
+ * through each GPIO backend.
+ * 
+ * With --self-test, commissions a cabinet instead: every output of every
+ * intersection in the config file (or the standard intersection) is driven
+ * with walking-ones and walking-zeros patterns, one batched write each,
+ * and the levels are read back after every write. A pin stuck high or low,
+ * or shorted to another, shows up in a pass/fail matrix, along with how
+ * long each pin took to read back.
+ * 
+ * Compile: see CMakeLists.txt (target "gpio_test")
+ * Run: sudo ./gpio_test [--bench [writes]]
+ *      sudo ./gpio_test --self-test [--backend NAME] [config-file]
  */
 
 #include <stdio.h>
@@ -12,6 +25,14 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <string.h>
+#ifdef HAVE_LIBGPIOD
+#include <gpiod.h>
+#include "gpio_gpiod.h"
+#endif
+#include "gpio_backend.h"
+#include "intersection.h"
+#include "phase_timer.h"
 
 // Try different possible base addresses for Pi 5
 #define BCM2712_PERI_BASE_1   0x1f00000000ULL
@@ -30,7 +51,7 @@ int test_gpio_address(uint64_t base_addr) {
     volatile uint32_t *gpio;
     uint64_t gpio_base = base_addr + GPIO_OFFSET;
     
-    printf("\nTesting GPIO base address: 0x%llx\n", gpio_base);
+    printf("\nTesting GPIO base address: 0x%llx\n", (unsigned long long)gpio_base);
     
     if ((mem_fd = open("/dev/mem", O_RDWR|O_SYNC)) < 0) {
         printf("  ✗ Cannot open /dev/mem\n");
@@ -126,7 +147,318 @@ int test_gpiomem() {
     return 1;
 }
 
-int main(void) {
+// ---------------------------------------------------------------------------
+// Benchmarks
+// ---------------------------------------------------------------------------
+
+#define BENCH_WRITES    100000
+#define MAX_WRITES      1000000
+
+static uint32_t samples[MAX_WRITES];
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sort the latencies of one run and print its table row
+static void report(const char *method, int writes, uint64_t elapsed_ns) {
+    qsort(samples, writes, sizeof(samples[0]), compare_u32);
+    printf("  %-28s %12.0f %9u %9u %9u\n", method,
+           writes / (elapsed_ns / 1e9),
+           samples[writes / 2], samples[(uint64_t)writes * 99 / 100], samples[writes - 1]);
+}
+
+// Time each of `writes` calls to write(i) individually
+#define BENCH(method, writes, write)                                    \
+    do {                                                                \
+        uint64_t start = clock_now_ns();                                \
+        for (int i = 0; i < (writes); i++) {                            \
+            uint64_t t0 = clock_now_ns();                               \
+            write;                                                      \
+            samples[i] = (uint32_t)(clock_now_ns() - t0);               \
+        }                                                               \
+        report((method), (writes), clock_now_ns() - start);             \
+    } while (0)
+
+// Map the GPIO registers the same ways the diagnostic tries them
+static volatile uint32_t *bench_map(void) {
+    const struct { const char *path; uint64_t offset; } maps[] = {
+        { "/dev/gpiomem", 0 },
+        { "/dev/mem", BCM2712_PERI_BASE_1 + GPIO_OFFSET },
+        { "/dev/mem", BCM2712_PERI_BASE_2 + GPIO_OFFSET },
+    };
+    
+    for (unsigned i = 0; i < sizeof(maps) / sizeof(maps[0]); i++) {
+        int fd = open(maps[i].path, O_RDWR|O_SYNC);
+        void *map;
+        
+        if (fd < 0) continue;
+        map = mmap(NULL, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, maps[i].offset);
+        close(fd);
+        if (map != MAP_FAILED) return (volatile uint32_t *)map;
+    }
+    return NULL;
+}
+
+static void bench_raw_store(int writes) {
+    volatile uint32_t *gpio = bench_map();
+    
+    if (!gpio) {
+        printf("  %-28s (no register mapping)\n", "raw mmap store");
+        return;
+    }
+    
+    // GPIO 17 as output
+    gpio[GPFSEL1] = (gpio[GPFSEL1] & ~(0b111 << 21)) | (0b001 << 21);
+    BENCH("raw mmap store", writes,
+          gpio[(i & 1) ? GPCLR0 : GPSET0] = (1 << TEST_PIN));
+    gpio[GPCLR0] = (1 << TEST_PIN);
+    munmap((void *)gpio, 4096);
+}
+
+#ifdef HAVE_LIBGPIOD
+// Request the standard intersection's pins as outputs on the header chip
+static struct gpiod_line_request *bench_request(struct gpiod_chip **chip,
+                                                const unsigned int *pins, int count) {
+    struct gpiod_line_settings *settings;
+    struct gpiod_line_config *line_cfg;
+    struct gpiod_line_request *request;
+    
+    *chip = gpio_gpiod_open_chip();
+    if (!*chip) return NULL;
+    
+    settings = gpiod_line_settings_new();
+    line_cfg = gpiod_line_config_new();
+    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT);
+    for (int i = 0; i < count; i++) gpiod_line_config_add_line_settings(line_cfg, &pins[i], 1, settings);
+    request = gpiod_chip_request_lines(*chip, NULL, line_cfg);
+    gpiod_line_config_free(line_cfg);
+    gpiod_line_settings_free(settings);
+    
+    if (!request) {
+        gpiod_chip_close(*chip);
+        *chip = NULL;
+    }
+    return request;
+}
+
+static void bench_gpiod(int writes, const struct intersection *isect) {
+    enum gpiod_line_value values[2][NUM_STD_HEADS];
+    struct gpiod_chip *chip;
+    struct gpiod_line_request *request = bench_request(&chip, isect->pins, NUM_STD_HEADS);
+    
+    if (!request) {
+        printf("  %-28s (cannot request lines)\n", "libgpiod");
+        return;
+    }
+    
+    BENCH("libgpiod set_value", writes,
+          gpiod_line_request_set_value(request, TEST_PIN, (i & 1) ? GPIOD_LINE_VALUE_INACTIVE
+                                                                  : GPIOD_LINE_VALUE_ACTIVE));
+    
+    // Alternate between all six lines on and all off
+    for (int head = 0; head < NUM_STD_HEADS; head++) {
+        values[0][head] = GPIOD_LINE_VALUE_ACTIVE;
+        values[1][head] = GPIOD_LINE_VALUE_INACTIVE;
+    }
+    BENCH("libgpiod set_values (6)", writes,
+          gpiod_line_request_set_values(request, values[i & 1]));
+    
+    gpiod_line_request_release(request);
+    gpiod_chip_close(chip);
+}
+#endif
+
+// A full phase change: the per-phase masks the controllers use, applied
+// through every backend built into this program
+static void bench_backends(int writes, const struct intersection *isect) {
+    for (int b = 0; gpio_backends[b] != NULL; b++) {
+        char method[64];
+        int phases = isect->table->plan.num_phases;
+        
+        gpio_backend = gpio_backends[b];
+        snprintf(method, sizeof(method), "set_light_state (%s)", gpio_backend->name);
+        if (gpio_backend->init() != 0) continue;
+        if (gpio_backend->configure_outputs(isect->pins, NUM_STD_HEADS) != 0) {
+            gpio_backend->close();
+            continue;
+        }
+        
+        BENCH(method, writes,
+              gpio_apply(isect->table->masks[i % phases].set_mask.bank[0],
+                         isect->table->masks[i % phases].clear_mask.bank[0]));
+        
+        gpio_apply(0, isect->pin_mask.bank[0]);
+        gpio_backend->close();
+    }
+}
+
+static int run_benchmarks(int writes) {
+    struct intersection isect;
+    
+    intersection_init_default(&isect);
+    
+    printf("\nBenchmarking %d writes per method (GPIO %u-%u)\n\n", writes,
+           isect.pins[0], isect.pins[NUM_STD_HEADS - 1]);
+    printf("  %-28s %12s %9s %9s %9s\n", "Method", "toggles/s", "p50 ns", "p99 ns", "max ns");
+    
+    // What the clock itself costs, so the rows below can be read net of it
+    BENCH("(clock overhead)", writes, (void)0);
+    bench_raw_store(writes);
+#ifdef HAVE_LIBGPIOD
+    bench_gpiod(writes, &isect);
+#endif
+    bench_backends(writes, &isect);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Self-test
+// ---------------------------------------------------------------------------
+
+#define SETTLE_NS       1000000ULL      // Longest a pin may take to read back
+#define NEVER_SETTLED   UINT64_MAX
+
+// Write one pattern - the pins in set high, those in clear low - and read
+// the levels back until every pin in expect_mask matches or SETTLE_NS
+// passes. Returns the pins that still read wrong. *settle_ns is how long
+// the pin in walked took to read back, or NEVER_SETTLED.
+static uint32_t drive_pattern(uint32_t set, uint32_t clear, uint32_t walked, uint64_t *settle_ns) {
+    uint32_t check = set | clear, wrong;
+    uint64_t start, now;
+    
+    *settle_ns = NEVER_SETTLED;
+    start = clock_now_ns();
+    gpio_apply(set, clear);
+    do {
+        uint32_t levels = gpio_read_levels();
+        
+        now = clock_now_ns();
+        wrong = (levels & check) ^ set;
+        if (*settle_ns == NEVER_SETTLED && !(wrong & walked)) *settle_ns = now - start;
+    } while (wrong && now - start < SETTLE_NS);
+    return wrong;
+}
+
+// Walk a one, then a zero, across the native outputs of one intersection
+// while every other output is held low. Returns the patterns that read
+// back wrong.
+static int self_test(const struct intersection *isect, uint32_t all_mask) {
+    int heads[MAX_HEADS], num = 0, failed = 0;
+    uint32_t mask = 0;
+    uint64_t start = clock_now_ns();
+    
+    for (int head = 0; head < isect->num_heads; head++) {
+        if ((isect->pwm_heads & HEAD_BIT(head)) || isect->pins[head] >= GPIO_BANK_PINS) continue;
+        heads[num++] = head;
+        mask |= 1u << isect->pins[head];
+    }
+    
+    printf("\n%s: %d output%s through %s", isect->name, num, num == 1 ? "" : "s", gpio_backend->name);
+    if (num < isect->num_heads) printf(" (%d PWM or expander heads not read back)", isect->num_heads - num);
+    printf("\n  %-22s", "Pattern");
+    for (int i = 0; i < num; i++) printf(" %3u", isect->pins[heads[i]]);
+    printf("  %9s\n", "settle us");
+    
+    for (int zeros = 0; zeros <= 1; zeros++) {
+        for (int i = 0; i < num; i++) {
+            uint32_t walked = 1u << isect->pins[heads[i]], others = all_mask & ~walked, wrong;
+            uint64_t settle_ns;
+            char label[32];
+            
+            // Walking zeros drive the rest of this intersection high
+            if (zeros) wrong = drive_pattern(mask & ~walked, walked | (others & ~mask), walked, &settle_ns);
+            else wrong = drive_pattern(walked, others, walked, &settle_ns);
+            
+            snprintf(label, sizeof(label), "%d on %s", !zeros, isect->head_names[heads[i]]);
+            printf("  %-22s", label);
+            for (int j = 0; j < num; j++) printf(" %3s", wrong & (1u << isect->pins[heads[j]]) ? "X" : ".");
+            if (settle_ns == NEVER_SETTLED) printf("  %9s", "never");
+            else printf("  %9.1f", settle_ns / 1e3);
+            
+            // A short to another intersection's pin shows up there
+            for (unsigned int pin = 0; pin < GPIO_BANK_PINS; pin++) {
+                if (wrong & ~mask & (1u << pin)) printf("  GPIO %u also moved", pin);
+            }
+            printf("\n");
+            if (wrong) failed++;
+        }
+    }
+    gpio_apply(0, all_mask);
+    
+    printf("  %s: %d of %d patterns read back wrong, %.1f ms\n", failed ? "FAIL" : "PASS", failed, 2 * num,
+           (clock_now_ns() - start) / 1e6);
+    return failed;
+}
+
+static int run_self_test(int argc, char *argv[]) {
+    static struct intersection isects[MAX_INTERSECTIONS];
+    const char *backend_name = NULL, *path = NULL;
+    unsigned int pins[GPIO_BANK_PINS];
+    uint32_t all_mask = 0;
+    int count, num_pins = 0, failed = 0;
+    
+    for (int i = 0; i < argc; i++) {
+        if ((strcmp(argv[i], "--backend") == 0 || strcmp(argv[i], "-b") == 0) && i + 1 < argc) {
+            backend_name = argv[++i];
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: gpio_test --self-test [--backend NAME] [config-file]\n");
+            return 1;
+        }
+    }
+    if (gpio_backend_select(backend_name) != 0) return 1;
+    
+    if (path) {
+        count = intersections_load(path, isects, MAX_INTERSECTIONS);
+        if (count < 0) return 1;
+    } else {
+        intersection_init_default(&isects[0]);
+        count = 1;
+    }
+    
+    // Every native output at once, so a short between intersections shows too
+    for (int i = 0; i < count; i++) {
+        for (int head = 0; head < isects[i].num_heads; head++) {
+            unsigned int pin = isects[i].pins[head];
+            
+            if ((isects[i].pwm_heads & HEAD_BIT(head)) || pin >= GPIO_BANK_PINS) continue;
+            pins[num_pins++] = pin;
+            all_mask |= 1u << pin;
+        }
+    }
+    if (gpio_backend->init() != 0) return 1;
+    if (gpio_backend->configure_outputs(pins, num_pins) != 0) {
+        gpio_backend->close();
+        return 1;
+    }
+    
+    printf("Self-test of %d output%s: walking ones, then walking zeros\n", num_pins, num_pins == 1 ? "" : "s");
+    printf("(. = read back as driven, X = read back wrong)\n");
+    gpio_apply(0, all_mask);
+    for (int i = 0; i < count; i++) failed += self_test(&isects[i], all_mask);
+    gpio_backend->close();
+    
+    if (failed) printf("\n✗ %d pattern%s read back wrong; check the wiring of the pins marked X\n",
+                       failed, failed == 1 ? "" : "s");
+    else printf("\n✓ Every output reads back as driven\n");
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        int writes = argc > 2 ? atoi(argv[2]) : BENCH_WRITES;
+        
+        if (writes < 1 || writes > MAX_WRITES) {
+            fprintf(stderr, "writes must be 1-%d\n", MAX_WRITES);
+            return 1;
+        }
+        return run_benchmarks(writes);
+    }
+    if (argc > 1 && strcmp(argv[1], "--self-test") == 0) return run_self_test(argc - 2, argv + 2);
+    
     printf("╔══════════════════════════════════════════╗\n");
     printf("║  Raspberry Pi 5 GPIO Diagnostic Tool    ║\n");
     printf("╚══════════════════════════════════════════╝\n");
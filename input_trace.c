@@ -0,0 +1,436 @@
+/*
+ * Input trace recording and deterministic replay
+ * See input_trace.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input_trace.h"
+#include "phase_timer.h"
+
+#define RING_MASK       (TRACE_RING_SIZE - 1)
+#define DRAIN_NS        10000000L   // Writer wakes every 10 ms
+#define PADDED(len)     (((size_t)(len) + 7) & ~(size_t)7)
+
+static const char *const type_names[] = {
+    "?", "buttons", "detectors", "signal", "flash", "trip", "clock", "offset", "plans", "output",
+};
+
+// Where the loop is. The same in the field and in a replay for as long as
+// the outputs are.
+static uint32_t writes;
+static uint64_t at_ns;
+
+// Recording: same single-producer/single-consumer scheme as the status
+// log, counting bytes instead of records
+static struct {
+    _Alignas(64) atomic_uint head;      // Bytes the control loop has put in
+    _Alignas(64) atomic_uint tail;      // Bytes the writer has taken out
+    uint8_t bytes[TRACE_RING_SIZE];
+} ring;
+
+static atomic_ullong dropped;
+static atomic_int running;
+static pthread_t thread;
+static FILE *out;
+
+// Replaying
+static const uint8_t *map;
+static size_t map_size;
+static size_t next;                     // Offset of the next record
+static int diverged;
+static uint32_t matched;                // Output writes that matched before it did
+static const struct trace_record *left;    // First record not taken, once closed
+static struct trace_record left_rec;
+static struct trace_record field_rec;   // What the field did instead (type 0: nothing)
+static struct gpio_mask field_masks[2], replay_masks[2];
+
+static uint64_t hash(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    
+    // FNV-1a
+    while (len--) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t input_trace_layout(const struct intersection *isects, int count) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    
+    for (int i = 0; i < count; i++) {
+        const struct intersection *isect = &isects[i];
+    
+        h = hash(h, isect->name, strlen(isect->name) + 1);
+        h = hash(h, isect->pins, isect->num_heads * sizeof(isect->pins[0]));
+        h = hash(h, &isect->pin_mask, sizeof(isect->pin_mask));
+        h = hash(h, &isect->button_mask, sizeof(isect->button_mask));
+        h = hash(h, isect->detectors, isect->num_detectors * sizeof(isect->detectors[0]));
+        h = hash(h, &isect->pwm_heads, sizeof(isect->pwm_heads));
+        h = hash(h, &isect->flash_heads, sizeof(isect->flash_heads));
+        h = hash(h, &isect->offset_ns, sizeof(isect->offset_ns));
+    
+        // Field by field: struct phase has padding
+        for (int p = 0; p < isect->sets[0].num_plans; p++) {
+            const struct phase_plan *plan = &isect->sets[0].plans[p].plan;
+    
+            h = hash(h, &plan->num_phases, sizeof(plan->num_phases));
+            for (int n = 0; n < plan->num_phases; n++) {
+                const struct phase *ph = &plan->phases[n];
+    
+                h = hash(h, &ph->heads, sizeof(ph->heads));
+                h = hash(h, &ph->duration_us, sizeof(ph->duration_us));
+                h = hash(h, &ph->max_us, sizeof(ph->max_us));
+                h = hash(h, &ph->gap_us, sizeof(ph->gap_us));
+                h = hash(h, &ph->next, sizeof(ph->next));
+                h = hash(h, &ph->call, sizeof(ph->call));
+            }
+        }
+    }
+    return h;
+}
+
+// ---------------------------------------------------------------------------
+// Recording
+// ---------------------------------------------------------------------------
+
+static void copy_in(unsigned int pos, const void *data, size_t len) {
+    size_t start = pos & RING_MASK, first = len < TRACE_RING_SIZE - start ? len : TRACE_RING_SIZE - start;
+    
+    memcpy(ring.bytes + start, data, first);
+    memcpy(ring.bytes, (const uint8_t *)data + first, len - first);
+}
+
+void input_trace_put(int type, const void *data, size_t len) {
+    static const uint8_t zeros[8];
+    struct trace_record rec = {
+        .type = type,
+        .len = len,
+        .writes = writes,
+        .at_ns = at_ns,
+        .time_ns = clock_now_ns(),
+    };
+    size_t size = sizeof(rec) + PADDED(len);
+    unsigned int head, tail;
+    
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) return;
+    
+    head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    
+    // Nothing waits on the virtual clock, so the writer may
+    while (TRACE_RING_SIZE - (head - tail) < size) {
+        if (!clock_is_virtual()) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+        sched_yield();
+        tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    }
+    copy_in(head, &rec, sizeof(rec));
+    copy_in(head + sizeof(rec), data, len);
+    copy_in(head + sizeof(rec) + len, zeros, PADDED(len) - len);
+    atomic_store_explicit(&ring.head, head + size, memory_order_release);
+}
+
+// Write out everything queued. Runs on the writer thread only.
+static void write_out(void) {
+    unsigned int tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring.head, memory_order_acquire);
+    
+    if (tail == head) return;
+    while (tail != head) {
+        size_t start = tail & RING_MASK, len = head - tail;
+    
+        if (len > TRACE_RING_SIZE - start) len = TRACE_RING_SIZE - start;
+        fwrite(ring.bytes + start, 1, len, out);
+        tail += len;
+        atomic_store_explicit(&ring.tail, tail, memory_order_release);
+    }
+    fflush(out);
+}
+
+static void *writer_thread(void *arg) {
+    const struct timespec period = { .tv_sec = 0, .tv_nsec = DRAIN_NS };
+    
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        write_out();
+        nanosleep(&period, NULL);
+    }
+    write_out();
+    return NULL;
+}
+
+int input_trace_record(const char *path, const struct trace_header *header) {
+    struct trace_header h = *header;
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_t attr;
+    int err;
+    
+    out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    memcpy(h.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    h.version = TRACE_VERSION;
+    if (fwrite(&h, sizeof(h), 1, out) != 1 || fflush(out) != 0) {
+        perror(path);
+        fclose(out);
+        out = NULL;
+        return -1;
+    }
+    
+    // Never inherit SCHED_FIFO from a real-time caller
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    
+    atomic_store(&running, 1);
+    err = pthread_create(&thread, &attr, writer_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start trace writer: %s\n", strerror(err));
+        atomic_store(&running, 0);
+        fclose(out);
+        out = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int input_trace_recording(void) {
+    return atomic_load_explicit(&running, memory_order_relaxed);
+}
+
+uint64_t input_trace_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Replaying
+// ---------------------------------------------------------------------------
+
+int input_trace_replay(const char *path, struct trace_header *header) {
+    struct stat st;
+    void *m;
+    int fd;
+    
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(*header)) {
+        fprintf(stderr, "%s: not a stoplight input trace\n", path);
+        close(fd);
+        return -1;
+    }
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        perror("Cannot map trace");
+        return -1;
+    }
+    
+    memcpy(header, m, sizeof(*header));
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || header->version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a stoplight input trace of this version\n", path);
+        munmap(m, st.st_size);
+        return -1;
+    }
+    map = m;
+    map_size = st.st_size;
+    next = sizeof(*header);
+    return 0;
+}
+
+int input_trace_replaying(void) {
+    return map != NULL;
+}
+
+// The next whole record of the replay, or NULL once there are none left
+// (or the rest was cut short by a crash) or the replay has diverged
+static const struct trace_record *peek(void) {
+    const struct trace_record *rec;
+    
+    if (!map || diverged || next + sizeof(*rec) > map_size) return NULL;
+    rec = (const struct trace_record *)(map + next);
+    if (next + sizeof(*rec) + PADDED(rec->len) > map_size) return NULL;
+    return rec;
+}
+
+static int here(const struct trace_record *rec) {
+    return rec->writes == writes && rec->at_ns == at_ns;
+}
+
+// The field did rec (or nothing more, if NULL) where the replay did something else
+static void diverge(const struct trace_record *rec) {
+    memset(&field_rec, 0, sizeof(field_rec));
+    if (rec) field_rec = *rec;
+    matched = writes;
+    diverged = 1;
+}
+
+void input_trace_at(uint64_t deadline_ns) {
+    const struct trace_record *rec;
+    
+    at_ns = deadline_ns;
+    
+    // The field never waited here, and the replay would wait forever
+    rec = peek();
+    if (rec && !here(rec) && deadline_ns == UINT64_MAX) diverge(rec);
+}
+
+const void *input_trace_take(int type, size_t *len) {
+    const struct trace_record *rec = peek();
+    
+    if (!rec || rec->type != type || !here(rec)) return NULL;
+    next += sizeof(*rec) + PADDED(rec->len);
+    
+    // The loop took it this late in the field
+    if (type != TRACE_OUTPUT) sleep_until_ns(rec->time_ns);
+    if (len) *len = rec->len;
+    return rec + 1;
+}
+
+int input_trace_due(void) {
+    const struct trace_record *rec = peek();
+    
+    return rec && here(rec) ? rec->type : 0;
+}
+
+int input_trace_output(const struct gpio_mask *set_mask, const struct gpio_mask *clear_mask) {
+    struct gpio_mask masks[2] = { *set_mask, *clear_mask };
+    const struct trace_record *rec = peek();
+    const void *field;
+    size_t len;
+    
+    if (input_trace_recording()) input_trace_put(TRACE_OUTPUT, masks, sizeof(masks));
+    if (rec) {
+        field = input_trace_take(TRACE_OUTPUT, &len);
+        if (!field || len != sizeof(masks) || memcmp(field, masks, sizeof(masks)) != 0) {
+            diverge(rec);
+            if (field) memcpy(field_masks, field, sizeof(field_masks));
+            memcpy(replay_masks, masks, sizeof(replay_masks));
+        }
+    }
+    writes++;
+    return diverged ? -1 : 0;
+}
+
+uint64_t input_trace_clock(uint64_t now_ns) {
+    const uint64_t *field;
+    
+    if (input_trace_replaying()) {
+        field = input_trace_take(TRACE_CLOCK, NULL);
+        if (field) return *field;
+        diverge(peek());
+        return now_ns;
+    }
+    input_trace_put(TRACE_CLOCK, &now_ns, sizeof(now_ns));
+    return now_ns;
+}
+
+int64_t input_trace_offset(int64_t offset_ns) {
+    const int64_t *field;
+    
+    if (input_trace_replaying()) {
+        field = input_trace_take(TRACE_OFFSET, NULL);
+        if (field) return *field;
+        diverge(peek());
+        return offset_ns;
+    }
+    input_trace_put(TRACE_OFFSET, &offset_ns, sizeof(offset_ns));
+    return offset_ns;
+}
+
+int input_trace_start_cycle(struct intersection *isect, int index) {
+    const struct plan_set *running_set = isect->set;
+    const struct trace_record *rec = peek();
+    struct trace_plans plans;
+    int changed;
+    
+    // Replay: the field's reloaded set goes where the reloader put it
+    if (rec && here(rec) && rec->type == TRACE_PLANS &&
+        ((const struct trace_plans *)(rec + 1))->isect == (uint32_t)index) {
+        const struct trace_plans *field = input_trace_take(TRACE_PLANS, NULL);
+        struct plan_set *spare = isect->set == &isect->sets[0] ? &isect->sets[1] : &isect->sets[0];
+    
+        *spare = *isect->set;
+        spare->num_plans = field->num_plans;
+        for (uint32_t i = 0; i < field->num_plans; i++) spare->plans[i].plan = field->plans[i];
+        intersection_build_set(isect, spare);
+        atomic_store_explicit(&isect->pending, spare, memory_order_release);
+    }
+    
+    changed = intersection_start_cycle(isect);
+    
+    // Recording: only what was actually taken, never a set still pending
+    if (isect->set != running_set && input_trace_recording()) {
+        plans.isect = index;
+        plans.num_plans = isect->set->num_plans;
+        for (int i = 0; i < isect->set->num_plans; i++) plans.plans[i] = isect->set->plans[i].plan;
+        input_trace_put(TRACE_PLANS, &plans,
+                        offsetof(struct trace_plans, plans) + plans.num_plans * sizeof(plans.plans[0]));
+    }
+    return changed;
+}
+
+int input_trace_finished(void) {
+    return map && !peek();
+}
+
+int input_trace_report(FILE *fp) {
+    const struct trace_record *rec = map ? peek() : left;
+    
+    if (diverged) {
+        fprintf(fp, "Replay diverged after %u matching output writes: ", matched);
+        if (field_rec.type == TRACE_OUTPUT && field_masks[0].bank[0] | field_masks[1].bank[0]) {
+            fprintf(fp, "the field wrote high %08x low %08x, the replay high %08x low %08x\n",
+                    field_masks[0].bank[0], field_masks[1].bank[0], replay_masks[0].bank[0], replay_masks[1].bank[0]);
+        } else if (field_rec.type > 0 && field_rec.type <= TRACE_OUTPUT) {
+            fprintf(fp, "the field took %s next, at %llu ns, after %u writes waiting for %llu ns\n",
+                    type_names[field_rec.type], (unsigned long long)field_rec.time_ns, field_rec.writes,
+                    (unsigned long long)field_rec.at_ns);
+        } else {
+            fprintf(fp, "the field did nothing more\n");
+        }
+        return -1;
+    }
+    if (rec) {
+        fprintf(fp, "Replay stopped with trace records left, at %llu ns\n", (unsigned long long)rec->time_ns);
+        return -1;
+    }
+    fprintf(fp, "Replay matched all %u output writes of the field\n", writes);
+    return 0;
+}
+
+void input_trace_close(void) {
+    if (atomic_load(&running)) {
+        atomic_store(&running, 0);
+        pthread_join(thread, NULL);
+        fclose(out);
+        out = NULL;
+    }
+    if (map) {
+        if (peek()) {
+            left_rec = *peek();
+            left = &left_rec;
+        }
+        munmap((void *)map, map_size);
+        map = NULL;
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * Input trace recording and deterministic replay
+ *
+ * Everything the control loop does follows from its plans and a handful
+ * of inputs: button and detector edges, signals, telemetry mode commands,
+ * a tripped conflict monitor, reloaded plan sets, and the few clock
+ * readings a plan is anchored to (the start epoch, a restart after flash
+ * mode, and the wall-clock offset behind coordination and the calendar).
+ * With --record the loop writes each input to a trace file at the moment
+ * it takes it, along with every output write it makes. --replay feeds
+ * the trace back to the same loop on the sim backend and the virtual
+ * clock, so hours of field operation replay in seconds, and checks each
+ * output write against the field's.
+ *
+ * An input is tied to where the loop was when it took it: how many output
+ * writes it had made and which deadline it was waiting for or acting on.
+ * Replay hands it over at the same place, whatever the wall clock did, and
+ * moves the virtual clock up to the time the field took it. Phase changes
+ * run on their planned deadlines, not on the time a wakeup happened to
+ * come, so given the same inputs at the same places the outputs are the
+ * same write for write.
+ *
+ * Recording never makes the loop wait: records are copied into a ring in
+ * memory that a normal-priority thread writes to the file. A record that
+ * doesn't fit is dropped and counted, and a replay of that trace diverges
+ * where it was lost. On the virtual clock the loop waits for room instead.
+ *
+ * File layout: a trace_header, then records, each a trace_record followed
+ * by its payload padded to 8 bytes.
+ */
+
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "gpio_mask.h"
+#include "intersection.h"
+
+#define TRACE_MAGIC         "STLTRCE"
+#define TRACE_VERSION       1
+#define TRACE_RING_SIZE     (1u << 20)      // Bytes; must be a power of two
+
+// Record types and their payloads
+#define TRACE_BUTTONS       1       // gpio_input_event[]: button edges read
+#define TRACE_DETECTORS     2       // gpio_input_event[]: detector edges drained
+#define TRACE_SIGNAL        3       // int32_t: signal number
+#define TRACE_FLASH         4       // int32_t: flash mode asked for over telemetry
+#define TRACE_TRIP          5       // none: the conflict monitor tripped
+#define TRACE_CLOCK         6       // uint64_t: clock_now_ns() a plan started at
+#define TRACE_OFFSET        7       // int64_t: clock_realtime_offset_ns()
+#define TRACE_PLANS         8       // trace_plans: a reloaded plan set taken
+#define TRACE_OUTPUT        9       // gpio_mask set, gpio_mask clear: one output write
+
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_isects;
+    uint64_t layout;                // input_trace_layout() of the intersections
+    uint64_t run_for_ns;            // Options the loop ran with
+    int32_t coordinated;
+    int32_t flash;
+};
+
+struct trace_record {
+    uint16_t type;
+    uint16_t len;                   // Payload bytes that follow
+    uint32_t writes;                // Output writes made before it
+    uint64_t at_ns;                 // Deadline the loop was waiting for or acting on
+    uint64_t time_ns;               // CLOCK_MONOTONIC when the loop took it
+};
+
+struct trace_plans {
+    uint32_t isect;
+    uint32_t num_plans;
+    struct phase_plan plans[MAX_PLANS];     // Only num_plans of them are written
+};
+
+_Static_assert(sizeof(struct trace_record) == 24, "trace records are packed by hand");
+_Static_assert(sizeof(struct trace_plans) < 65536, "trace payload length is 16 bits");
+
+// A hash of everything in the config file that decides the outputs:
+// wiring, offsets and the plans loaded at startup
+uint64_t input_trace_layout(const struct intersection *isects, int count);
+
+// Start recording to path, after writing header. Call before
+// realtime_enter(): the writer thread keeps normal priority.
+// Returns 0 on success, -1 after printing an error.
+int input_trace_record(const char *path, const struct trace_header *header);
+
+// Open a trace for replay and copy out its header
+// Returns 0 on success, -1 after printing an error.
+int input_trace_replay(const char *path, struct trace_header *header);
+
+int input_trace_recording(void);
+int input_trace_replaying(void);
+
+// Tell the trace which deadline the loop waits for next
+void input_trace_at(uint64_t deadline_ns);
+
+// Recording: append one record of type with len bytes of data at the
+// loop's current place. Does nothing otherwise.
+void input_trace_put(int type, const void *data, size_t len);
+
+// Replaying: if the next record is of type and was taken at the loop's
+// current place, move the virtual clock up to its time and return its
+// payload (and its length in *len unless len is NULL). Otherwise NULL.
+const void *input_trace_take(int type, size_t *len);
+
+// Replaying: the type of the next record if it was taken at the loop's
+// current place, else 0
+int input_trace_due(void);
+
+// Record an output write, or check it against the field's in a replay.
+// Returns 0, or -1 once the replay has diverged.
+int input_trace_output(const struct gpio_mask *set_mask, const struct gpio_mask *clear_mask);
+
+// A clock reading or wall-clock offset the outputs depend on: recorded
+// and returned, or replaced by the field's in a replay
+uint64_t input_trace_clock(uint64_t now_ns);
+int64_t input_trace_offset(int64_t offset_ns);
+
+// intersection_start_cycle() for intersection index, with a reloaded plan
+// set taken from pending treated as an input: recorded when it is taken,
+// or put back in pending at the same place in a replay
+int input_trace_start_cycle(struct intersection *isect, int index);
+
+// Replaying: non-zero once every record was taken or the replay diverged
+int input_trace_finished(void);
+
+// Stop the writer thread after it has written everything, or unmap the
+// replayed trace
+void input_trace_close(void);
+
+// Print how the replay went. Returns 0 if every output write matched the
+// field and every record was taken, else -1.
+int input_trace_report(FILE *fp);
+
+// Records lost because the ring was full
+uint64_t input_trace_dropped(void);
+
+#endif
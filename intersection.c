@@ -0,0 +1,466 @@
+/*
+ * Intersection definitions and config-file loading
+ * See intersection.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intersection.h"
+
+// Standard wiring, in head order
+static const unsigned int default_pins[NUM_STD_HEADS] = {
+    17, 27, 22,     // Street A: red, yellow, green
+    23, 24, 25      // Street B: red, yellow, green
+};
+
+void intersection_init_default(struct intersection *isect) {
+    memset(isect, 0, sizeof(*isect));
+    snprintf(isect->name, sizeof(isect->name), "default");
+    memcpy(isect->pins, default_pins, sizeof(default_pins));
+    isect->num_heads = NUM_STD_HEADS;
+    for (int head = 0; head < NUM_STD_HEADS; head++) {
+        snprintf(isect->head_names[head], HEAD_NAME_LEN, "%s", std_head_names[head]);
+    }
+    isect->sets[0].num_plans = 1;
+    snprintf(isect->sets[0].names[0], PLAN_NAME_LEN, "default");
+    isect->sets[0].plans[0].plan = default_plan;
+    intersection_build(isect);
+}
+
+void intersection_build(struct intersection *isect) {
+    // PWM heads are left to their PWM channel
+    memset(&isect->pin_mask, 0, sizeof(isect->pin_mask));
+    for (int head = 0; head < isect->num_heads; head++) {
+        if (!(isect->pwm_heads & HEAD_BIT(head))) gpio_mask_add(&isect->pin_mask, isect->pins[head]);
+    }
+    isect->button_mask = 0;
+    for (int i = 0; i < isect->num_buttons; i++) {
+        isect->button_mask |= 1u << isect->buttons[i];
+    }
+    isect->detector_mask = 0;
+    for (int i = 0; i < isect->num_detectors; i++) {
+        isect->detector_mask |= 1u << isect->detectors[i].pin;
+    }
+    
+    // Nothing to flash: hold all-red on whichever red heads are GPIOs
+    memset(&isect->flash_masks, 0, sizeof(isect->flash_masks));
+    if (!isect->flash_heads) {
+        if (!(isect->pwm_heads & HEAD_BIT(HEAD_A_RED))) gpio_mask_add(&isect->flash_masks.set_mask, isect->pins[HEAD_A_RED]);
+        if (!(isect->pwm_heads & HEAD_BIT(HEAD_B_RED))) gpio_mask_add(&isect->flash_masks.set_mask, isect->pins[HEAD_B_RED]);
+    }
+    for (int b = 0; b < GPIO_BANKS; b++) {
+        isect->flash_masks.clear_mask.bank[b] = isect->pin_mask.bank[b] & ~isect->flash_masks.set_mask.bank[b];
+    }
+    
+    intersection_build_set(isect, &isect->sets[0]);
+    isect->set = &isect->sets[0];
+    isect->plan = isect->next_plan = 0;
+    isect->table = &isect->set->plans[0];
+    atomic_init(&isect->pending, NULL);
+}
+
+// Precompute the pin writes and nominal cycle of one plan
+static void build_table(const struct intersection *isect, struct plan_table *table) {
+    for (int i = 0; i < table->plan.num_phases; i++) {
+        struct gpio_mask on = { 0 };
+        
+        for (int head = 0; head < isect->num_heads; head++) {
+            if (table->plan.phases[i].heads & HEAD_BIT(head)) gpio_mask_add(&on, isect->pins[head]);
+        }
+        for (int b = 0; b < GPIO_BANKS; b++) {
+            table->masks[i].set_mask.bank[b] = on.bank[b] & isect->pin_mask.bank[b];
+            table->masks[i].clear_mask.bank[b] = isect->pin_mask.bank[b] & ~on.bank[b];
+        }
+    }
+    
+    // Nominal cycle: follow the plain next links from phase 0 back round
+    table->cycle_ns = 0;
+    for (int i = 0, phase = 0; i < table->plan.num_phases; i++) {
+        const struct phase *p = &table->plan.phases[phase];
+        
+        table->cycle_ns += (uint64_t)p->duration_us * 1000;
+        phase = p->next == PHASE_RETURN ? 0 : p->next;
+        if (phase == 0) break;
+    }
+}
+
+void intersection_build_set(const struct intersection *isect, struct plan_set *set) {
+    // Dark and all-red are always allowed: startup, shutdown and flash
+    uint64_t allowed = 1ULL | 1ULL << MONITOR_STATE(isect, HEAD_BIT(HEAD_A_RED) | HEAD_BIT(HEAD_B_RED));
+    
+    for (int i = 0; i < set->num_plans; i++) {
+        const struct phase_plan *plan = &set->plans[i].plan;
+        
+        build_table(isect, &set->plans[i]);
+        for (int p = 0; p < plan->num_phases; p++) allowed |= 1ULL << MONITOR_STATE(isect, plan->phases[p].heads);
+    }
+    
+    // The conflict monitor may be reading it, even on a spare
+    __atomic_store_n(&set->allowed, allowed, __ATOMIC_RELEASE);
+}
+
+int intersection_find_plan(const struct intersection *isect, const char *name) {
+    for (int i = 0; i < isect->set->num_plans; i++) {
+        if (strcmp(name, isect->set->names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+int intersection_start_cycle(struct intersection *isect) {
+    const struct plan_set *next = atomic_load_explicit(&isect->pending, memory_order_acquire);
+    
+    if (next) {
+        // The old set is unreachable from here on, so the reloader may
+        // reuse it as soon as it sees pending cleared
+        isect->set = next;
+        isect->table = &next->plans[isect->plan];
+        isect->resume = 0;
+        atomic_store_explicit(&isect->pending, NULL, memory_order_release);
+    }
+    if (isect->next_plan == isect->plan) return next != NULL;
+    
+    isect->plan = isect->next_plan;
+    isect->table = &isect->set->plans[isect->plan];
+    isect->resume = 0;
+    return 1;
+}
+
+void intersection_call(struct intersection *isect, uint64_t time_ns) {
+    if (isect->ped_call) return;
+    isect->ped_call = 1;
+    isect->ped_call_ns = time_ns;
+}
+
+int intersection_actuate(struct intersection *isect, unsigned int pin, uint64_t time_ns) {
+    const struct phase *cur = &isect->table->plan.phases[isect->phase];
+    uint64_t end, min_end, max_end;
+    
+    for (int i = 0; i < isect->num_detectors; i++) {
+        if (isect->detectors[i].pin != pin) continue;
+        if (!cur->gap_us || !(cur->heads & HEAD_BIT(isect->detectors[i].head))) return 0;
+        
+        // Hold the phase one gap past the pulse, within its min and max
+        min_end = isect->phase_start_ns + (uint64_t)cur->duration_us * 1000;
+        max_end = isect->phase_start_ns + (uint64_t)cur->max_us * 1000;
+        end = time_ns + (uint64_t)cur->gap_us * 1000;
+        if (end < min_end) end = min_end;
+        if (end > max_end) end = max_end;
+        
+        if (end <= isect->deadline_ns) return 0;
+        isect->deadline_ns = end;
+        return 1;
+    }
+    return 0;
+}
+
+int intersection_next_phase(struct intersection *isect) {
+    const struct phase *cur = &isect->table->plan.phases[isect->phase];
+    
+    if (isect->ped_call && cur->call != PHASE_NONE) {
+        isect->ped_call = 0;
+        if (cur->next != PHASE_RETURN) isect->resume = cur->next;
+        return cur->call;
+    }
+    return cur->next == PHASE_RETURN ? isect->resume : cur->next;
+}
+
+// Parse a pin number below limit: inputs must be native GPIOs
+// (GPIO_BANK_PINS), outputs may be on expanders (MAX_GPIO)
+static int parse_gpio(const char *tok, unsigned int *pin, unsigned int limit) {
+    char *end;
+    long value = strtol(tok, &end, 10);
+    
+    if (*end != '\0' || end == tok || value < 0 || value >= limit) return -1;
+    *pin = (unsigned int)value;
+    return 0;
+}
+
+static int find_head_name(const struct intersection *isect, const char *name) {
+    for (int head = 0; head < isect->num_heads; head++) {
+        if (strcmp(name, isect->head_names[head]) == 0) return head;
+    }
+    return -1;
+}
+
+// Parse the six GPIO numbers of a "pins" line
+static int parse_pins(struct intersection *isect, char *args) {
+    char *save, *tok;
+    int count = 0;
+    
+    for (tok = strtok_r(args, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        if (count == NUM_STD_HEADS || parse_gpio(tok, &isect->pins[count], MAX_GPIO) != 0) return -1;
+        count++;
+    }
+    return count == NUM_STD_HEADS ? 0 : -1;
+}
+
+// Parse the name and GPIO of a "head" line
+static int parse_head(struct intersection *isect, char *args) {
+    char *save, *name, *pin, *extra;
+    
+    name = strtok_r(args, " \t", &save);
+    pin = strtok_r(NULL, " \t", &save);
+    extra = strtok_r(NULL, " \t", &save);
+    if (!name || !pin || extra || strlen(name) >= HEAD_NAME_LEN) return -1;
+    if (isect->num_heads == MAX_HEADS) return -1;
+    for (int head = 0; head < isect->num_heads; head++) {
+        if (strcmp(name, isect->head_names[head]) == 0) return -1;
+    }
+    if (parse_gpio(pin, &isect->pins[isect->num_heads], MAX_GPIO) != 0) return -1;
+    
+    snprintf(isect->head_names[isect->num_heads], HEAD_NAME_LEN, "%s", name);
+    isect->num_heads++;
+    return 0;
+}
+
+// Parse the GPIO of a "button" line
+static int parse_button(struct intersection *isect, char *args) {
+    char *save, *pin, *extra;
+    
+    pin = strtok_r(args, " \t", &save);
+    extra = strtok_r(NULL, " \t", &save);
+    if (!pin || extra || isect->num_buttons == MAX_BUTTONS) return -1;
+    if (parse_gpio(pin, &isect->buttons[isect->num_buttons], GPIO_BANK_PINS) != 0) return -1;
+    
+    isect->num_buttons++;
+    return 0;
+}
+
+// Parse the GPIO and head name of a "detector" line
+static int parse_detector(struct intersection *isect, char *args) {
+    char *save, *pin, *name, *extra;
+    struct detector *det = &isect->detectors[isect->num_detectors];
+    
+    pin = strtok_r(args, " \t", &save);
+    name = strtok_r(NULL, " \t", &save);
+    extra = strtok_r(NULL, " \t", &save);
+    if (!pin || !name || extra || isect->num_detectors == MAX_DETECTORS) return -1;
+    if (parse_gpio(pin, &det->pin, GPIO_BANK_PINS) != 0) return -1;
+    
+    det->head = find_head_name(isect, name);
+    if (det->head < 0) return -1;
+    
+    isect->num_detectors++;
+    return 0;
+}
+
+// Parse the head, chip and channel of a "pwm" line
+static int parse_pwm(struct intersection *isect, char *args) {
+    char *save, *name, *chip, *channel, *extra, *end;
+    struct pwm_head *ph = &isect->pwm[isect->num_pwm];
+    long c, ch;
+    
+    name = strtok_r(args, " \t", &save);
+    chip = strtok_r(NULL, " \t", &save);
+    channel = strtok_r(NULL, " \t", &save);
+    extra = strtok_r(NULL, " \t", &save);
+    if (!name || !chip || !channel || extra || isect->num_pwm == MAX_PWM_HEADS) return -1;
+    
+    ph->head = find_head_name(isect, name);
+    c = strtol(chip, &end, 10);
+    if (*end != '\0' || c < 0 || c > 63) return -1;
+    ch = strtol(channel, &end, 10);
+    if (*end != '\0' || ch < 0 || ch > 63) return -1;
+    if (ph->head < 0 || (isect->pwm_heads & HEAD_BIT(ph->head))) return -1;
+    
+    ph->pwm.chip = (unsigned int)c;
+    ph->pwm.channel = (unsigned int)ch;
+    ph->pwm.period_fd = ph->pwm.duty_fd = ph->pwm.enable_fd = -1;
+    isect->pwm_heads |= HEAD_BIT(ph->head);
+    isect->num_pwm++;
+    return 0;
+}
+
+// Parse the heads of a "flash" line; each must already be a PWM head
+static int parse_flash(struct intersection *isect, char *args) {
+    char *save, *tok;
+    
+    for (tok = strtok_r(args, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        int head = find_head_name(isect, tok);
+        
+        if (head < 0 || !(isect->pwm_heads & HEAD_BIT(head))) return -1;
+        isect->flash_heads |= HEAD_BIT(head);
+    }
+    return 0;
+}
+
+// Phase lines look heads up by name
+static int parse_phase(struct intersection *isect, char *args) {
+    struct plan_set *set = &isect->sets[0];
+    const char *names[MAX_HEADS];
+    
+    for (int head = 0; head < isect->num_heads; head++) names[head] = isect->head_names[head];
+    return phase_parse(&set->plans[set->num_plans - 1].plan, args, names, isect->num_heads);
+}
+
+// Start a named plan; the phase lines after it belong to it
+static int parse_plan(struct intersection *isect, char *args) {
+    struct plan_set *set = &isect->sets[0];
+    char *save, *name = strtok_r(args, " \t", &save);
+    
+    if (!name || strtok_r(NULL, " \t", &save) || strlen(name) >= PLAN_NAME_LEN) return -1;
+    if (set->num_plans == MAX_PLANS || strcmp(name, "flash") == 0) return -1;
+    for (int i = 0; i < set->num_plans; i++) {
+        if (strcmp(name, set->names[i]) == 0) return -1;
+    }
+    snprintf(set->names[set->num_plans], PLAN_NAME_LEN, "%s", name);
+    set->plans[set->num_plans++].plan.num_phases = 0;
+    return 0;
+}
+
+// Fill in defaults, check and precompute a fully parsed intersection
+static int finish_intersection(const char *path, struct intersection *isect,
+                               const struct intersection *others, int num_others) {
+    struct plan_set *set = &isect->sets[0];
+    struct gpio_mask inputs = { 0 };
+    
+    if (set->plans[0].plan.num_phases == 0) set->plans[0].plan = default_plan;
+    for (int i = 0; i < set->num_plans; i++) {
+        struct phase_plan *plan = &set->plans[i].plan;
+        
+        phase_plan_finish(plan);
+        if (phase_plan_validate(plan) != 0) {
+            fprintf(stderr, "%s: intersection %s: invalid phase plan %s\n", path, isect->name, set->names[i]);
+            return -1;
+        }
+    }
+    
+    intersection_build(isect);
+    inputs.bank[0] = isect->button_mask | isect->detector_mask;
+    
+    if (gpio_mask_count(&isect->pin_mask) != isect->num_heads - isect->num_pwm ||
+        __builtin_popcount(isect->button_mask) != isect->num_buttons ||
+        __builtin_popcount(isect->detector_mask) != isect->num_detectors ||
+        (isect->button_mask & isect->detector_mask) || gpio_mask_overlaps(&isect->pin_mask, &inputs)) {
+        fprintf(stderr, "%s: intersection %s: a pin is used twice\n", path, isect->name);
+        return -1;
+    }
+    for (int i = 0; i < num_others; i++) {
+        struct gpio_mask used = others[i].pin_mask, ours = isect->pin_mask;
+        
+        used.bank[0] |= others[i].button_mask | others[i].detector_mask;
+        gpio_mask_or(&ours, &inputs);
+        if (gpio_mask_overlaps(&ours, &used)) {
+            fprintf(stderr, "%s: intersection %s shares pins with %s\n",
+                    path, isect->name, others[i].name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int intersections_load(const char *path, struct intersection *list, int max) {
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    int count = 0, line_no = 0;
+    struct intersection *cur = NULL;
+    
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    
+    while (fgets(line, sizeof(line), fp)) {
+        char *save, *key, *args;
+        
+        line_no++;
+        line[strcspn(line, "#\n")] = '\0';
+        key = strtok_r(line, " \t", &save);
+        if (!key) continue;
+        args = strtok_r(NULL, "", &save);
+        if (!args) args = "";
+        
+        // Calendar lines are read by schedule_load(), expanders by expander_load()
+        if (strcmp(key, "schedule") == 0 || strcmp(key, "holiday") == 0 || strcmp(key, "expander") == 0) continue;
+        
+        if (strcmp(key, "intersection") == 0) {
+            if (cur && finish_intersection(path, cur, list, count - 1) != 0) goto fail;
+            if (count == max) {
+                fprintf(stderr, "%s:%d: more than %d intersections\n", path, line_no, max);
+                goto fail;
+            }
+            cur = &list[count++];
+            char *name = strtok_r(args, " \t", &save);
+            
+            intersection_init_default(cur);
+            cur->sets[0].plans[0].plan.num_phases = 0;
+            snprintf(cur->name, sizeof(cur->name), "%s", name ? name : "unnamed");
+            continue;
+        }
+        
+        if (!cur) {
+            fprintf(stderr, "%s:%d: '%s' outside an intersection block\n", path, line_no, key);
+            goto fail;
+        }
+        
+        if (strcmp(key, "pins") == 0) {
+            if (parse_pins(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: expected six output pins (0-%d)\n", path, line_no, MAX_GPIO - 1);
+                goto fail;
+            }
+        } else if (strcmp(key, "head") == 0) {
+            if (parse_head(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: expected a new head name and one output pin (0-%d)\n",
+                        path, line_no, MAX_GPIO - 1);
+                goto fail;
+            }
+        } else if (strcmp(key, "button") == 0) {
+            if (parse_button(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: expected one GPIO number (0-31), at most %d buttons\n",
+                        path, line_no, MAX_BUTTONS);
+                goto fail;
+            }
+        } else if (strcmp(key, "detector") == 0) {
+            if (parse_detector(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: expected a GPIO number (0-31) and a head name, at most %d detectors\n",
+                        path, line_no, MAX_DETECTORS);
+                goto fail;
+            }
+        } else if (strcmp(key, "pwm") == 0) {
+            if (parse_pwm(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: expected a head name, PWM chip and channel, at most %d PWM heads\n",
+                        path, line_no, MAX_PWM_HEADS);
+                goto fail;
+            }
+        } else if (strcmp(key, "flash") == 0) {
+            if (parse_flash(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: flash heads must have a pwm line first\n", path, line_no);
+                goto fail;
+            }
+        } else if (strcmp(key, "offset") == 0) {
+            char *end;
+            long ms = strtol(args, &end, 10);
+            
+            if (end == args || strspn(end, " \t") != strlen(end) || ms < 0 || ms > 3600000) {
+                fprintf(stderr, "%s:%d: expected an offset in ms (0-3600000)\n", path, line_no);
+                goto fail;
+            }
+            cur->offset_ns = (uint64_t)ms * 1000000;
+        } else if (strcmp(key, "plan") == 0) {
+            if (parse_plan(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: expected a new plan name, at most %d plans\n", path, line_no, MAX_PLANS);
+                goto fail;
+            }
+        } else if (strcmp(key, "phase") == 0) {
+            if (parse_phase(cur, args) != 0) {
+                fprintf(stderr, "%s:%d: bad phase, expected <ms> <head>... [next=N|return] [call=N] [max=MS gap=MS]\n",
+                        path, line_no);
+                goto fail;
+            }
+        } else {
+            fprintf(stderr, "%s:%d: unknown keyword '%s'\n", path, line_no, key);
+            goto fail;
+        }
+    }
+    
+    if (cur && finish_intersection(path, cur, list, count - 1) != 0) goto fail;
+    fclose(fp);
+    
+    if (count == 0) fprintf(stderr, "%s: no intersections defined\n", path);
+    return count ? count : -1;
+    
+fail:
+    fclose(fp);
+    return -1;
+}
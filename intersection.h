@@ -0,0 +1,168 @@
+/*
+ * One signalised intersection: the pins its heads are wired to, the plan
+ * it runs, and where it currently is in that plan
+ *
+ * Intersections are described in a config file, one block each:
+ *
+ *   intersection main_st
+ *       pins 17 27 22 23 24 25      # a_red a_yellow a_green b_red b_yellow b_green
+ *       head walk 5                 # optional extra heads, named for phase lines
+ *       head a_left 32              #   (output pins 32 and up are on expanders,
+ *                                   #   see gpio_mask.h and gpio_expander.h)
+ *       button 26                   # optional pedestrian push buttons
+ *       detector 12 a_green         # optional vehicle detector and the head it serves
+ *       pwm a_yellow 0 2            # optional: head driven by pwmchip0 channel 2
+ *       flash a_yellow              # heads that flash in flash mode (PWM heads)
+ *       offset 12000                # coordinated mode: cycle starts 12 s after the reference
+ *       phase 5000 a_green b_red    # optional; default_plan if omitted
+ *       ...
+ *       plan am_peak                # optional named plans for the calendar
+ *       phase 9000 a_green b_red    #   (see schedule.h); phases up to here
+ *       ...                         #   are the plan called "default"
+ *
+ * A button press is latched as a pedestrian call and served at the next
+ * phase with a call= safe point. A detector pulse extends the current
+ * phase if it is actuated and lights the detector's head (see
+ * phase_parse()).
+ *
+ * A PWM head is not driven through the GPIO backend: its PWM channel is
+ * programmed when it turns on or off, at the configured brightness. In
+ * flash mode the PWM block flashes the flash heads by itself; intersections
+ * without any hold all-red instead.
+ *
+ * The plans are an immutable plan_set, and the one running is a
+ * plan_table in it. A reload (see plan_reload.h) builds a new set in the
+ * spare slot and hands it over through pending; the control loop takes it
+ * at the next cycle boundary, and the old one is then the spare. A plan
+ * picked by the calendar is switched to at a cycle boundary the same way.
+ */
+
+#ifndef INTERSECTION_H
+#define INTERSECTION_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "gpio_mask.h"
+#include "phase_table.h"
+#include "pwm.h"
+
+#define MAX_INTERSECTIONS   16
+#define MAX_BUTTONS         4
+#define MAX_DETECTORS       8
+#define MAX_PWM_HEADS       4
+#define HEAD_NAME_LEN       16
+#define MAX_PLANS           8       // Named plans per intersection, "default" included
+#define PLAN_NAME_LEN       16
+#define BUTTON_DEBOUNCE_US  20000   // Contact bounce ignored after a press
+
+// Precomputed pin writes for one phase
+struct phase_masks {
+    struct gpio_mask set_mask;      // Pins to drive high
+    struct gpio_mask clear_mask;    // Pins to drive low
+};
+
+// A validated plan and everything precomputed from it. Never written while
+// the control loop can reach it.
+struct plan_table {
+    struct phase_plan plan;
+    struct phase_masks masks[MAX_PHASES];
+    uint64_t cycle_ns;                  // Phase 0 to phase 0 without calls or extensions
+};
+
+// Every plan of an intersection, as loaded together. Never written while
+// the control loop can reach it.
+struct plan_set {
+    int num_plans;
+    char names[MAX_PLANS][PLAN_NAME_LEN];   // names[0] is "default"
+    struct plan_table plans[MAX_PLANS];
+    uint64_t allowed;                   // Bit n: the GPIO standard heads may show state n
+                                        // (last: the monitor reads it atomically at any time)
+};
+
+// A vehicle detector and the head whose green it holds
+struct detector {
+    unsigned int pin;
+    int head;
+};
+
+// A head driven by a PWM channel instead of a GPIO
+struct pwm_head {
+    int head;
+    struct pwm_channel pwm;
+};
+
+struct intersection {
+    char name[32];
+    int num_heads;                      // Standard heads plus any "head" lines
+    unsigned int pins[MAX_HEADS];       // Output pin driving each head
+    char head_names[MAX_HEADS][HEAD_NAME_LEN];
+    struct gpio_mask pin_mask;          // Every pin this intersection drives
+    int num_buttons;
+    unsigned int buttons[MAX_BUTTONS];  // GPIO of each pedestrian button
+    uint32_t button_mask;
+    int num_detectors;
+    struct detector detectors[MAX_DETECTORS];
+    uint32_t detector_mask;
+    int num_pwm;
+    struct pwm_head pwm[MAX_PWM_HEADS];
+    head_mask_t pwm_heads;
+    head_mask_t flash_heads;            // Flashed by PWM in flash mode
+    struct phase_masks flash_masks;     // GPIO writes for flash mode
+    struct plan_set sets[2];            // The running plans and a spare for reloads
+    const struct plan_set *set;         // The running one; only the control loop reads it
+    const struct plan_table *table;     // The plan running now, in set
+    int plan;                           // Index of that plan
+    int next_plan;                      // Plan to run from the next cycle
+    _Atomic(const struct plan_set *) pending;   // Reloaded set, taken at phase 0
+    uint64_t offset_ns;                 // Coordinated mode: cycle start after the reference
+    
+    int phase;                          // Index of the current phase
+    int cycle;                          // Completed cycles + 1
+    uint64_t phase_start_ns;            // When the current phase started
+    uint64_t deadline_ns;               // When the current phase ends
+    int ped_call;                       // A button was pressed, not yet served
+    uint64_t ped_call_ns;               // Kernel timestamp of that press
+    int resume;                         // Where next=return goes
+};
+
+// Standard wiring from TRAFFIC_LIGHT_SETUP.md running default_plan
+void intersection_init_default(struct intersection *isect);
+
+// Compute the pin masks from the pin assignment, and the tables of the
+// plans in sets[0]
+void intersection_build(struct intersection *isect);
+
+// Standard-head state of a head mask, as the conflict monitor sees it:
+// bits 0-5 of the GPIO-driven standard heads
+#define MONITOR_STATE(isect, heads) \
+    ((unsigned int)((heads) & ~(isect)->pwm_heads & (HEAD_BIT(NUM_STD_HEADS) - 1)))
+
+// Precompute the rest of every table in a set, and the states its plans
+// allow, from its plans and the pin assignment. allowed is written last,
+// in one atomic store.
+void intersection_build_set(const struct intersection *isect, struct plan_set *set);
+
+// Index of the named plan in the running set, or -1
+int intersection_find_plan(const struct intersection *isect, const char *name);
+
+// Switch to a reloaded set and to next_plan, if either changed. Only the
+// control loop may call this, at a cycle boundary. Returns 1 if the
+// running table changed.
+int intersection_start_cycle(struct intersection *isect);
+
+// Latch a button press. Presses while a call is waiting are ignored.
+void intersection_call(struct intersection *isect, uint64_t time_ns);
+
+// Apply a detector pulse to the current phase. Returns 1 if that moved
+// deadline_ns later, 0 if the phase is fixed or the pulse is not for it.
+int intersection_actuate(struct intersection *isect, unsigned int pin, uint64_t time_ns);
+
+// Phase that follows the current one, serving a waiting call if the
+// current phase is a safe point
+int intersection_next_phase(struct intersection *isect);
+
+// Load every intersection block from a config file
+// Returns the number loaded, or -1 after printing an error.
+int intersections_load(const char *path, struct intersection *list, int max);
+
+#endif
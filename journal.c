@@ -0,0 +1,115 @@
+/*
+ * Transition journal for post-incident analysis
+ * See journal.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.h"
+
+#define JOURNAL_SIZE    (JOURNAL_HEADER_SIZE + (size_t)JOURNAL_RECORDS * sizeof(struct journal_record))
+
+static void *map;
+static struct journal_record *records;
+static uint64_t next_seq;           // Kept here, not in the file: one store per record
+
+static int header_valid(const struct journal_header *h) {
+    return memcmp(h->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) == 0 &&
+           h->version == JOURNAL_VERSION &&
+           h->record_size == sizeof(struct journal_record) &&
+           h->num_records == JOURNAL_RECORDS;
+}
+
+int journal_open(const char *path, const struct intersection *isects, int count) {
+    struct journal_header *h;
+    struct stat st;
+    int fd;
+    
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size != JOURNAL_SIZE && ftruncate(fd, JOURNAL_SIZE) != 0)) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    
+    // Fault every page in now rather than on the first write to it
+    map = mmap(NULL, JOURNAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Cannot map journal");
+        map = NULL;
+        return -1;
+    }
+    h = map;
+    records = (struct journal_record *)((char *)map + JOURNAL_HEADER_SIZE);
+    
+    // Keep an existing journal and carry on after its newest record
+    next_seq = 1;
+    if (header_valid(h)) {
+        for (uint32_t i = 0; i < JOURNAL_RECORDS; i++) {
+            if (records[i].seq >= next_seq) next_seq = records[i].seq + 1;
+        }
+    } else {
+        memset(map, 0, JOURNAL_SIZE);
+        memcpy(h->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        h->version = JOURNAL_VERSION;
+        h->record_size = sizeof(struct journal_record);
+        h->num_records = JOURNAL_RECORDS;
+    }
+    
+    h->num_isects = count;
+    for (int i = 0; i < count; i++) {
+        snprintf(h->isect_names[i], sizeof(h->isect_names[i]), "%s", isects[i].name);
+    }
+    return 0;
+}
+
+void journal_record(const struct intersection *isect, int index,
+                    uint64_t scheduled_ns, uint64_t actual_ns) {
+    struct journal_record rec;
+    struct journal_record *slot;
+    struct timespec real;
+    
+    if (!records) return;
+    
+    // vDSO call, no syscall
+    clock_gettime(CLOCK_REALTIME, &real);
+    
+    memset(&rec, 0, sizeof(rec));
+    rec.mono_ns = actual_ns;
+    rec.real_ns = (uint64_t)real.tv_sec * 1000000000ULL + real.tv_nsec;
+    rec.jitter_ns = (int64_t)(actual_ns - scheduled_ns);
+    rec.mask = isect->table->masks[isect->phase].set_mask.bank[0];
+    for (int b = 1; b < GPIO_BANKS; b++) rec.expander_mask[b - 1] = isect->table->masks[isect->phase].set_mask.bank[b];
+    rec.cycle = isect->cycle;
+    rec.isect = index;
+    rec.phase = isect->phase;
+    rec.flags = isect->ped_call ? JOURNAL_PED_CALL : 0;
+    
+    // Body first, seq last: a record cut short by a crash reads as empty
+    slot = &records[(next_seq - 1) % JOURNAL_RECORDS];
+    slot->seq = 0;
+    atomic_signal_fence(memory_order_seq_cst);
+    memcpy((char *)slot + sizeof(slot->seq), (char *)&rec + sizeof(rec.seq), sizeof(rec) - sizeof(rec.seq));
+    atomic_signal_fence(memory_order_seq_cst);
+    slot->seq = next_seq++;
+}
+
+void journal_close(void) {
+    if (!map) return;
+    msync(map, JOURNAL_SIZE, MS_SYNC);
+    munmap(map, JOURNAL_SIZE);
+    map = NULL;
+    records = NULL;
+}
@@ -0,0 +1,67 @@
+/*
+ * Transition journal for post-incident analysis
+ *
+ * Every phase change is appended to a preallocated circular file that is
+ * memory-mapped for the life of the program. An entry is one 64-byte
+ * record - one cache line - written with plain stores: no syscalls, no
+ * locks. The kernel owns the pages, so everything written up to a crash
+ * is still in the file afterwards. stoplight_journal decodes it.
+ *
+ * File layout: a one-page header, then JOURNAL_RECORDS record slots.
+ * Slot n % JOURNAL_RECORDS holds record n; a slot's seq is 0 until it is
+ * first written, so readers sort the non-empty slots by seq.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "intersection.h"
+
+#define JOURNAL_MAGIC       "STLJRNL"
+#define JOURNAL_VERSION     1
+#define JOURNAL_HEADER_SIZE 4096
+#define JOURNAL_RECORDS     65536       // 4 MB of history
+
+#define JOURNAL_PED_CALL    0x01        // A pedestrian call was waiting
+
+struct journal_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_records;
+    uint32_t num_isects;                // Intersections of the last run
+    char isect_names[MAX_INTERSECTIONS][32];
+};
+
+struct journal_record {
+    uint64_t seq;           // Record number + 1, stored last; 0 = empty
+    uint64_t mono_ns;       // CLOCK_MONOTONIC time of the output write
+    uint64_t real_ns;       // CLOCK_REALTIME at the same moment
+    int64_t jitter_ns;      // How late the write was (negative = early)
+    uint32_t mask;          // Native pins of this intersection driven high
+    uint32_t cycle;
+    uint16_t isect;
+    uint8_t phase;
+    uint8_t flags;
+    uint32_t expander_mask[GPIO_BANKS - 1];    // Banks 1-3 driven high
+    uint8_t reserved[20 - 4 * (GPIO_BANKS - 1)];
+};
+
+_Static_assert(sizeof(struct journal_header) <= JOURNAL_HEADER_SIZE, "journal header too big");
+_Static_assert(sizeof(struct journal_record) == 64, "journal records are one cache line");
+
+// Map the journal at path, creating or resetting it if it isn't a journal
+// of this format, and continue after the newest record. Call before
+// realtime_enter() so its pages are locked in. Returns 0 or -1 after
+// printing an error.
+int journal_open(const char *path, const struct intersection *isects, int count);
+
+// Append one phase change. Does nothing unless a journal is open.
+void journal_record(const struct intersection *isect, int index,
+                    uint64_t scheduled_ns, uint64_t actual_ns);
+
+// Flush the journal to disk and unmap it
+void journal_close(void);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Transition journal reader
+ * Decodes the journal written by stoplight --journal, oldest record first
+ * 
+ * Compile: see CMakeLists.txt (target "stoplight_journal")
+ * Run: ./stoplight_journal <journal-file> [last-N]
+ * 
+ * Output columns: sequence number, wall-clock time, monotonic time,
+ * intersection, cycle, phase, pins driven high, and how late the write was.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "journal.h"
+
+static int by_seq(const void *a, const void *b) {
+    uint64_t sa = (*(const struct journal_record *const *)a)->seq;
+    uint64_t sb = (*(const struct journal_record *const *)b)->seq;
+    
+    return sa < sb ? -1 : sa > sb;
+}
+
+int main(int argc, char *argv[]) {
+    const struct journal_header *h;
+    const struct journal_record *records, **order;
+    struct stat st;
+    size_t count = 0, first = 0;
+    void *map;
+    int fd;
+    
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <journal-file> [last-N]\n", argv[0]);
+        return 1;
+    }
+    
+    fd = open(argv[1], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    if ((size_t)st.st_size < JOURNAL_HEADER_SIZE) {
+        fprintf(stderr, "%s: not a stoplight journal\n", argv[1]);
+        return 1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap error");
+        return 1;
+    }
+    
+    h = map;
+    if (memcmp(h->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        h->version != JOURNAL_VERSION || h->record_size != sizeof(struct journal_record) ||
+        (size_t)st.st_size < JOURNAL_HEADER_SIZE + (size_t)h->num_records * h->record_size) {
+        fprintf(stderr, "%s: not a stoplight journal (or a different version)\n", argv[1]);
+        return 1;
+    }
+    records = (const struct journal_record *)((const char *)map + JOURNAL_HEADER_SIZE);
+    
+    // Slots are reused in a ring, so put the written ones in order
+    order = malloc(h->num_records * sizeof(*order));
+    if (!order) {
+        perror("malloc");
+        return 1;
+    }
+    for (uint32_t i = 0; i < h->num_records; i++) {
+        if (records[i].seq != 0) order[count++] = &records[i];
+    }
+    qsort(order, count, sizeof(*order), by_seq);
+    if (argc == 3 && (size_t)atol(argv[2]) < count) first = count - atol(argv[2]);
+    
+    printf("%-10s %-26s %14s  %-16s %5s %5s %-8s %10s\n",
+           "seq", "realtime", "monotonic (s)", "intersection", "cycle", "phase", "mask", "late (us)");
+    for (size_t i = first; i < count; i++) {
+        const struct journal_record *r = order[i];
+        time_t sec = r->real_ns / 1000000000ULL;
+        char when[32], name[32];
+        struct tm tm;
+        
+        localtime_r(&sec, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+        if (r->isect < h->num_isects && r->isect < MAX_INTERSECTIONS) {
+            snprintf(name, sizeof(name), "%s", h->isect_names[r->isect]);
+        } else {
+            snprintf(name, sizeof(name), "#%u", r->isect);
+        }
+        
+        printf("%-10llu %s.%06llu %14.6f  %-16s %5u %5u %08x %10.1f%s",
+               (unsigned long long)r->seq, when, (unsigned long long)(r->real_ns % 1000000000ULL) / 1000,
+               r->mono_ns / 1e9, name, r->cycle, r->phase, r->mask, r->jitter_ns / 1e3,
+               r->flags & JOURNAL_PED_CALL ? "  ped call" : "");
+        for (int b = 1; b < GPIO_BANKS; b++) {
+            if (r->expander_mask[b - 1]) printf("  bank %d %04x", b, r->expander_mask[b - 1]);
+        }
+        printf("\n");
+    }
+    
+    free(order);
+    munmap(map, st.st_size);
+    return 0;
+}
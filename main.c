@@ -1,6 +1,504 @@
+/*
+ * Traffic light controller for one or more intersections
+ *
+ * Runs every intersection described in a config file from a single
+ * process and a single timer loop, writing all heads through one GPIO
+ * backend. Without a config file it drives the standard two-way
+ * intersection from TRAFFIC_LIGHT_SETUP.md.
+ *
+ * Compile: see CMakeLists.txt (target "stoplight")
+ * Run: sudo ./stoplight [--backend mmap|rp1|gpiod|sim] [config-file]
+ *
+ * Simulation: ./stoplight --virtual --duration 604800 --trace week.txt
+ * runs a week of phase changes on the sim backend in a few seconds.
+ *
+ * With --journal FILE every phase change is also kept in a crash-safe
+ * binary journal; decode it with stoplight_journal.
+ *
+ * With --record FILE every input the loop takes is kept in a trace, and
+ * ./stoplight --replay FILE [config-file] runs the same inputs again on
+ * the sim backend and the virtual clock, checking that every output
+ * write matches (see input_trace.h).
+ *
+ * Press Ctrl+C (or send SIGTERM) to exit. Send SIGUSR1 (kill -USR1 <pid>) for a phase-timing
+ * report; one is also printed on exit. SIGUSR2 switches between the plans
+ * and flash mode.
+ *
+ * --monitor runs an independent conflict monitor that reads the lights
+ * back and forces all-red if they ever show something no plan allows.
+ *
+ * schedule lines in the config file switch plans by time of day and day
+ * of week (see schedule.h).
+ *
+ * Send SIGHUP after editing the config file to reload its phase lines;
+ * each intersection switches to its new plan at its next cycle.
+ *
+ * With --telemetry PORT a central monitor can query the state of every
+ * intersection and switch flash mode over UDP (see telemetry.h).
+ *
+ * With --status-page local programs can read the state of every
+ * intersection from shared memory instead (see status_page.h and
+ * stoplight_status).
+ *
+ * With --coordinated the cycles follow the wall clock and each
+ * intersection's offset, for green waves across NTP/PTP-synced controllers.
+ */
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include "controller.h"
+#include "detector.h"
+#include "gpio_backend.h"
+#include "gpio_expander.h"
+#include "gpio_sim.h"
+#include "input_trace.h"
+#include "intersection.h"
+#include "journal.h"
+#include "monitor.h"
+#include "phase_timer.h"
+#include "plan_reload.h"
+#include "pwm.h"
+#include "realtime.h"
+#include "schedule.h"
+#include "status_log.h"
+#include "status_page.h"
+#include "telemetry.h"
+#include "timing_stats.h"
+
+static struct intersection intersections[MAX_INTERSECTIONS];
+static struct schedule schedule;
+static struct controller controller;
+
+volatile int keep_running = 1;
+
+// Undo everything started after the backend was initialised
+static void release(void) {
+    monitor_stop();
+    plan_reload_stop();
+    telemetry_stop();
+    controller_close();
+    status_page_close();
+    status_log_stop();
+    detector_stop();
+    input_trace_close();
+    journal_close();
+    for (int i = 0; i < MAX_INTERSECTIONS; i++) {
+        for (int p = 0; p < intersections[i].num_pwm; p++) pwm_close(&intersections[i].pwm[p].pwm);
+    }
+    expander_close();
+    gpio_backend->close();
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] [config-file]\n", prog);
+    fprintf(stderr, "  -b, --backend NAME   GPIO backend:");
+    for (int i = 0; gpio_backends[i] != NULL; i++) fprintf(stderr, " %s", gpio_backends[i]->name);
+    fprintf(stderr, " (default %s)\n", gpio_backends[0]->name);
+    fprintf(stderr, "  -v, --virtual        Simulate on a virtual clock, without sleeping\n");
+    fprintf(stderr, "  -d, --duration SEC   Stop after SEC seconds (simulated with --virtual)\n");
+    fprintf(stderr, "  -t, --trace FILE     Record every sim backend output change to FILE\n");
+    fprintf(stderr, "  -j, --journal FILE   Keep a binary journal of phase changes in FILE\n");
+    fprintf(stderr, "      --record FILE    Record every input of the loop to FILE\n");
+    fprintf(stderr, "      --replay FILE    Replay a recorded run on the virtual clock and check it\n");
+    fprintf(stderr, "  -r, --realtime[=P]   SCHED_FIFO priority P (default %d), locked memory\n",
+            RT_DEFAULT_PRIORITY);
+    fprintf(stderr, "  -c, --cpu N          CPU to pin the loop to with --realtime\n");
+    fprintf(stderr, "                       (default: first isolated CPU, else the last CPU)\n");
+    fprintf(stderr, "      --dim PCT        Brightness of PWM heads, 1-100 (default 100)\n");
+    fprintf(stderr, "      --flash          Start in flash mode (SIGUSR2 toggles it)\n");
+    fprintf(stderr, "      --coordinated    Lock cycles to the wall clock plus each offset\n");
+    fprintf(stderr, "      --telemetry PORT Answer status queries and mode commands on UDP PORT\n");
+    fprintf(stderr, "      --monitor[=CPU]  Read the lights back and force all-red on a conflict\n");
+    fprintf(stderr, "      --status-page[=NAME]  Publish state in shared memory (default %s)\n",
+            STATUS_PAGE_NAME);
+}
 
-int main(void) {
-    printf("Hello, World!\n");
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        { "backend",  required_argument, NULL, 'b' },
+        { "virtual",  no_argument,       NULL, 'v' },
+        { "duration", required_argument, NULL, 'd' },
+        { "trace",    required_argument, NULL, 't' },
+        { "journal",  required_argument, NULL, 'j' },
+        { "realtime", optional_argument, NULL, 'r' },
+        { "cpu",      required_argument, NULL, 'c' },
+        { "dim",      required_argument, NULL, 'D' },
+        { "flash",    no_argument,       NULL, 'F' },
+        { "coordinated", no_argument,    NULL, 'C' },
+        { "telemetry", required_argument, NULL, 'T' },
+        { "monitor",  optional_argument, NULL, 'M' },
+        { "record",   required_argument, NULL, 'R' },
+        { "replay",   required_argument, NULL, 'P' },
+        { "status-page", optional_argument, NULL, 'S' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    unsigned int pins[32], buttons[32], detectors[32];    // Every native GPIO is used at most once
+    struct gpio_mask all_pins = { 0 }, no_pins = { 0 };
+    const char *backend_name = NULL, *trace_path = NULL, *journal_path = NULL;
+    const char *record_path = NULL, *replay_path = NULL, *page_name = NULL;
+    struct trace_header trace = { 0 };
+    uint64_t run_for_ns;
+    FILE *trace_fp = NULL;
+    int count, num_pins = 0, num_buttons = 0, num_detectors = 0, opt, virtual_clock = 0;
+    int button_group = -1;
+    int rt_priority = 0, rt_cpu = -1, dim_percent = 100, flash = 0, coordinated = 0;
+    int telemetry_port = 0, num_rules = 0, monitor = 0, monitor_cpu = -1;
+    double duration = 0;
+    
+    while ((opt = getopt_long(argc, argv, "b:vd:t:j:r::c:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'b':
+            backend_name = optarg;
+            break;
+        case 'v':
+            virtual_clock = 1;
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'j':
+            journal_path = optarg;
+            break;
+        case 'R':
+            record_path = optarg;
+            break;
+        case 'P':
+            replay_path = optarg;
+            break;
+        case 'S':
+            page_name = optarg ? optarg : STATUS_PAGE_NAME;
+            break;
+        case 'r':
+            rt_priority = optarg ? atoi(optarg) : RT_DEFAULT_PRIORITY;
+            if (rt_priority < 1 || rt_priority > 99) {
+                fprintf(stderr, "Real-time priority must be 1-99\n");
+                return 1;
+            }
+            break;
+        case 'c':
+            rt_cpu = atoi(optarg);
+            break;
+        case 'D':
+            dim_percent = atoi(optarg);
+            if (dim_percent < 1 || dim_percent > 100) {
+                fprintf(stderr, "Brightness must be 1-100\n");
+                return 1;
+            }
+            break;
+        case 'F':
+            flash = 1;
+            break;
+        case 'C':
+            coordinated = 1;
+            break;
+        case 'M':
+            monitor = 1;
+            if (optarg) monitor_cpu = atoi(optarg);
+            break;
+        case 'T':
+            telemetry_port = atoi(optarg);
+            if (telemetry_port < 1 || telemetry_port > 65535) {
+                fprintf(stderr, "Telemetry port must be 1-65535\n");
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    run_for_ns = (uint64_t)(duration * 1e9);
+    
+    // A replay runs with the options the field ran with, on the virtual clock
+    if (replay_path) {
+        if (virtual_clock || duration > 0 || flash || coordinated || telemetry_port || monitor || record_path) {
+            fprintf(stderr, "--replay takes the run's options from the trace; give only a backend and config\n");
+            return 1;
+        }
+        if (input_trace_replay(replay_path, &trace) != 0) return 1;
+        run_for_ns = trace.run_for_ns;
+        coordinated = trace.coordinated;
+        flash = trace.flash;
+    }
+    
+    // Simulation only makes sense without real lights attached
+    if ((virtual_clock || trace_path || replay_path) && !backend_name) backend_name = "sim";
+    if (gpio_backend_select(backend_name) != 0) return 1;
+    if ((virtual_clock || trace_path || replay_path) && strcmp(gpio_backend->name, "sim") != 0) {
+        fprintf(stderr, "--virtual, --trace and --replay need the sim backend\n");
+        return 1;
+    }
+    if (virtual_clock && duration <= 0) {
+        fprintf(stderr, "--virtual needs --duration\n");
+        return 1;
+    }
+    if (virtual_clock && (coordinated || telemetry_port || monitor)) {
+        fprintf(stderr, "--coordinated, --telemetry and --monitor need the real clock, not --virtual\n");
+        return 1;
+    }
+    
+    if (optind < argc) {
+        count = intersections_load(argv[optind], intersections, MAX_INTERSECTIONS);
+        if (count < 0) return 1;
+        num_rules = schedule_load(argv[optind], &schedule);
+        if (num_rules < 0 || (num_rules && schedule_bind(&schedule, intersections, count) != 0)) return 1;
+        if (expander_load(argv[optind]) < 0) return 1;
+    } else {
+        intersection_init_default(&intersections[0]);
+        count = 1;
+    }
+    if (replay_path && (trace.num_isects != (uint32_t)count ||
+                        trace.layout != input_trace_layout(intersections, count))) {
+        fprintf(stderr, "%s was recorded with a different config\n", replay_path);
+        return 1;
+    }
+    
+    printf("Controlling %d intersection%s:\n", count, count == 1 ? "" : "s");
+    for (int i = 0; i < count; i++) {
+        const struct intersection *isect = &intersections[i];
+        
+        printf("  %-16s pins %u %u %u / %u %u %u", isect->name,
+               isect->pins[HEAD_A_RED], isect->pins[HEAD_A_YELLOW], isect->pins[HEAD_A_GREEN],
+               isect->pins[HEAD_B_RED], isect->pins[HEAD_B_YELLOW], isect->pins[HEAD_B_GREEN]);
+        for (int head = NUM_STD_HEADS; head < isect->num_heads; head++) {
+            printf(", %s %u", isect->head_names[head], isect->pins[head]);
+        }
+        for (int b = 0; b < isect->num_buttons; b++) printf(", button %u", isect->buttons[b]);
+        for (int d = 0; d < isect->num_detectors; d++) {
+            printf(", detector %u %s", isect->detectors[d].pin,
+                   isect->head_names[isect->detectors[d].head]);
+        }
+        for (int p = 0; p < isect->num_pwm; p++) {
+            printf(", %s on pwmchip%u/pwm%u", isect->head_names[isect->pwm[p].head],
+                   isect->pwm[p].pwm.chip, isect->pwm[p].pwm.channel);
+        }
+        printf(", %d phases", isect->table->plan.num_phases);
+        for (int p = 1; p < isect->set->num_plans; p++) printf(", plan %s", isect->set->names[p]);
+        if (coordinated) {
+            printf(", cycle %llu ms offset %llu ms", (unsigned long long)(isect->table->cycle_ns / 1000000),
+                   (unsigned long long)(isect->offset_ns / 1000000));
+        }
+        printf("\n");
+        
+        for (int head = 0; head < isect->num_heads; head++) {
+            if (!(isect->pwm_heads & HEAD_BIT(head)) && isect->pins[head] < GPIO_BANK_PINS) {
+                pins[num_pins++] = isect->pins[head];
+            }
+        }
+        for (int b = 0; b < isect->num_buttons; b++) buttons[num_buttons++] = isect->buttons[b];
+        for (int d = 0; d < isect->num_detectors; d++) detectors[num_detectors++] = isect->detectors[d].pin;
+        gpio_mask_or(&all_pins, &isect->pin_mask);
+    }
+    
+    // Ctrl+C and the other signals reach the loop through its signalfd;
+    // blocked before any thread starts so none of them takes one instead
+    controller_block_signals();
+    
+    if (num_rules) {
+        printf("Calendar: %d rule%s, %d holiday%s\n", num_rules, num_rules == 1 ? "" : "s",
+               schedule.num_holidays, schedule.num_holidays == 1 ? "" : "s");
+    }
+    
+    printf("\nUsing GPIO backend: %s\n", gpio_backend->name);
+    if (gpio_backend->init() != 0) return 1;
+    if (gpio_backend->configure_outputs(pins, num_pins) != 0) {
+        release();
+        return 1;
+    }
+    
+    // Expander pins are written over I2C/SPI instead; simulated along with the backend
+    if (strcmp(gpio_backend->name, "sim") == 0) expander_simulate();
+    if (expander_configure_outputs(&all_pins) != 0) {
+        release();
+        return 1;
+    }
+    if (num_buttons) {
+        if (!gpio_backend->configure_inputs) {
+            fprintf(stderr, "The %s backend has no button inputs; use gpiod\n", gpio_backend->name);
+            release();
+            return 1;
+        }
+        button_group = gpio_backend->configure_inputs(buttons, num_buttons, BUTTON_DEBOUNCE_US);
+        if (button_group < 0) {
+            release();
+            return 1;
+        }
+    }
+    
+    // PWM heads bypass the GPIO backend; simulated along with it
+    if (strcmp(gpio_backend->name, "sim") == 0) pwm_simulate();
+    for (int i = 0; i < count; i++) {
+        for (int p = 0; p < intersections[i].num_pwm; p++) {
+            struct pwm_head *ph = &intersections[i].pwm[p];
+            
+            if (pwm_open(&ph->pwm, ph->pwm.chip, ph->pwm.channel) != 0) {
+                release();
+                return 1;
+            }
+        }
+    }
+    
+    // Started before --realtime so the input thread keeps normal priority
+    if (num_detectors && detector_start(detectors, num_detectors) != 0) {
+        release();
+        return 1;
+    }
+    
+    if (trace_path) {
+        trace_fp = fopen(trace_path, "w");
+        if (!trace_fp) {
+            perror(trace_path);
+            release();
+            return 1;
+        }
+        gpio_sim_trace(trace_fp);
+    }
+    
+    // Mapped before --realtime so its pages are locked in too
+    if (journal_path && journal_open(journal_path, intersections, count) != 0) {
+        release();
+        return 1;
+    }
+    
+    // Mapped before --realtime so its page is locked in too
+    if (page_name && status_page_open(page_name, intersections, count) != 0) {
+        release();
+        return 1;
+    }
+    
+    // Its writer thread keeps normal priority too
+    if (record_path) {
+        struct trace_header header = {
+            .num_isects = count,
+            .layout = input_trace_layout(intersections, count),
+            .run_for_ns = run_for_ns,
+            .coordinated = coordinated,
+            .flash = flash,
+        };
+        
+        if (input_trace_record(record_path, &header) != 0) {
+            release();
+            return 1;
+        }
+    }
+    
+    // The status line is written by its own thread, off the phase loop
+    if (!virtual_clock && !replay_path && status_log_start(stdout, count, controller_print_status, intersections) != 0) {
+        release();
+        return 1;
+    }
+    
+    if (controller_init(&controller, intersections, count) != 0) {
+        release();
+        return 1;
+    }
+    controller.button_group = button_group;
+    controller.dim_percent = dim_percent;
+    controller.flash = flash;
+    controller.coordinated = coordinated;
+    if (num_rules) controller.schedule = &schedule;
+    if (coordinated && !clock_realtime_synced()) {
+        fprintf(stderr, "Warning: the system clock is not synchronised; "
+                "offsets are only as good as its time\n");
+    }
+    controller.run_for_ns = run_for_ns;
+    
+    // Plans are re-read by a normal-priority thread too; a replay takes
+    // the field's reloads from the trace instead
+    if (optind < argc && !replay_path && plan_reload_start(argv[optind], intersections, count) != 0) {
+        release();
+        return 1;
+    }
+    
+    // Also a normal-priority thread; it wakes this one for mode commands
+    if (telemetry_port && telemetry_start(telemetry_port, intersections, count) != 0) {
+        release();
+        return 1;
+    }
+    
+    // Its own real-time thread, above the loop, ideally on its own CPU
+    if (monitor) {
+        if (monitor_start(intersections, count, monitor_cpu, rt_priority ? MONITOR_PRIORITY : 0) != 0) {
+            release();
+            return 1;
+        }
+        printf("Conflict monitor: every %d us, %s within %d us of a conflict\n",
+               MONITOR_PERIOD_US, gpio_backend->concurrent_apply ? "all-red" : "wakes the loop",
+               (MONITOR_CONFIRM + 1) * MONITOR_PERIOD_US);
+    }
+    
+    if (rt_priority) {
+        if (rt_cpu < 0) rt_cpu = realtime_pick_cpu();
+        if (realtime_enter(rt_priority, rt_cpu) != 0) {
+            release();
+            return 1;
+        }
+        
+        // Fault in the GPIO mapping before the first phase, not during it
+        (void)gpio_read_levels();
+        printf("Real-time mode: SCHED_FIFO priority %d on CPU %d, memory locked\n",
+               rt_priority, rt_cpu);
+    }
+    
+    if (replay_path) {
+        clock_use_virtual();
+        controller.quiet = 1;
+        printf("\nReplaying %s on a virtual clock...\n", replay_path);
+    } else if (virtual_clock) {
+        clock_use_virtual();
+        controller.quiet = 1;
+        printf("\nSimulating %.0f s on a virtual clock...\n", duration);
+    } else {
+        printf("\nStarting traffic light sequence... (Press Ctrl+C to exit)\n\n");
+    }
+    
+    controller_run(&controller, &keep_running);
+    status_log_stop();      // Flush the status line before the report
+    
+    // Clean up - turn off all lights
+    printf("\n\nCleaning up...\n");
+    gpio_apply_banks(&no_pins, &all_pins);
+    release();
+    
+    timing_stats_dump(stdout, intersections, count);
+    if (monitor) {
+        unsigned int state;
+        int isect = monitor_fault(&state);
+        
+        if (isect >= 0) {
+            printf("CONFLICT: %s showed A:%s B:%s; held in flash mode\n", intersections[isect].name,
+                   street_color(state, HEAD_A_RED), street_color(state, HEAD_B_RED));
+        }
+    }
+    if (status_log_dropped()) {
+        printf("Status records dropped (output too slow): %llu\n",
+               (unsigned long long)status_log_dropped());
+    }
+    if (input_trace_dropped()) {
+        printf("Trace records dropped (ring full): %llu\n", (unsigned long long)input_trace_dropped());
+    }
+    if (num_detectors && detector_dropped()) {
+        printf("Detector events dropped (ring full): %llu\n", (unsigned long long)detector_dropped());
+    }
+    if (expander_errors()) {
+        printf("Expander writes failed: %llu\n", (unsigned long long)expander_errors());
+    }
+    if (strcmp(gpio_backend->name, "sim") == 0) {
+        printf("Recorded %llu output transitions\n", (unsigned long long)gpio_sim_transition_count());
+    }
+    if (trace_fp) fclose(trace_fp);
+    if (replay_path && input_trace_report(stdout) != 0) return 1;
+    
+    printf("Traffic light stopped. Stay safe out there! 🚦\n");
     return 0;
-}
\ No newline at end of file
+}
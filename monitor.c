@@ -0,0 +1,169 @@
+/*
+ * Conflict monitor
+ * See monitor.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "monitor.h"
+#include "controller.h"
+#include "gpio_backend.h"
+
+#define NSEC_PER_SEC    1000000000L
+
+// Where to find the standard heads of one intersection in the levels
+struct watch {
+    unsigned int pins[NUM_STD_HEADS];
+    unsigned int heads;                 // Bit h: head h is a GPIO
+    const uint64_t *allowed[2];         // Of both plan sets, running and spare
+};
+
+static struct watch watches[MAX_INTERSECTIONS];
+static int num_watches;
+static int direct;                      // The backend can take the all-red from this thread
+static uint32_t red_set, red_clear;     // All-red on every intersection
+
+static atomic_int running;
+static atomic_int tripped;
+static int fault_isect = -1;
+static unsigned int fault_state;
+static pthread_t thread;
+
+static unsigned int state_of(const struct watch *w, uint32_t levels) {
+    unsigned int state = 0;
+    
+    for (int head = 0; head < NUM_STD_HEADS; head++) {
+        if (w->heads & (1u << head)) state |= ((levels >> w->pins[head]) & 1) << head;
+    }
+    return state;
+}
+
+// A reload replaces the spare's table in one store; either table allows a state
+static int allowed(const struct watch *w, unsigned int state) {
+    uint64_t table = __atomic_load_n(w->allowed[0], __ATOMIC_RELAXED) |
+                     __atomic_load_n(w->allowed[1], __ATOMIC_RELAXED);
+    
+    return (table >> state) & 1;
+}
+
+// Where the backend allows it, drive all-red at once, whatever the loop
+// is doing; otherwise the loop is the only writer and flashes all-red as
+// soon as it takes the wake. Standard heads are all on bank 0.
+static void trip(int isect, unsigned int state) {
+    if (direct) gpio_apply(red_set, red_clear);
+    fault_isect = isect;
+    fault_state = state;
+    atomic_store_explicit(&tripped, 1, memory_order_release);
+    controller_wake();
+}
+
+static void *monitor_thread(void *arg) {
+    struct timespec next;
+    int strikes = 0;
+    
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        uint32_t levels = gpio_read_levels();
+        int bad = -1;
+        unsigned int state = 0;
+        
+        for (int i = 0; i < num_watches && bad < 0; i++) {
+            state = state_of(&watches[i], levels);
+            if (!allowed(&watches[i], state)) bad = i;
+        }
+        
+        // Once tripped the loop keeps flash; there is nothing more to do
+        if (bad < 0) {
+            strikes = 0;
+        } else if (strikes < MONITOR_CONFIRM && ++strikes == MONITOR_CONFIRM &&
+                   !atomic_load_explicit(&tripped, memory_order_relaxed)) {
+            trip(bad, state);
+        }
+        
+        next.tv_nsec += MONITOR_PERIOD_US * 1000;
+        if (next.tv_nsec >= NSEC_PER_SEC) {
+            next.tv_nsec -= NSEC_PER_SEC;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+int monitor_start(const struct intersection *isects, int count, int cpu, int priority) {
+    struct sched_param param = { .sched_priority = priority };
+    pthread_attr_t attr;
+    int err;
+    
+    red_set = red_clear = 0;
+    for (int i = 0; i < count; i++) {
+        const struct intersection *isect = &isects[i];
+        struct watch *w = &watches[i];
+        uint32_t red = 0;
+        
+        w->heads = 0;
+        for (int head = 0; head < NUM_STD_HEADS; head++) {
+            w->pins[head] = isect->pins[head];
+            if (!(isect->pwm_heads & HEAD_BIT(head))) w->heads |= 1u << head;
+            
+            // Expander latches can't be read back at the monitor's rate
+            if ((w->heads & (1u << head)) && isect->pins[head] >= GPIO_BANK_PINS) {
+                fprintf(stderr, "Intersection %s: the conflict monitor needs standard heads on GPIO 0-%d\n",
+                        isect->name, GPIO_BANK_PINS - 1);
+                return -1;
+            }
+        }
+        w->allowed[0] = &isect->sets[0].allowed;
+        w->allowed[1] = &isect->sets[1].allowed;
+        
+        if (w->heads & (1u << HEAD_A_RED)) red |= 1u << isect->pins[HEAD_A_RED];
+        if (w->heads & (1u << HEAD_B_RED)) red |= 1u << isect->pins[HEAD_B_RED];
+        red_set |= red;
+        red_clear |= isect->pin_mask.bank[0] & ~red;
+    }
+    num_watches = count;
+    direct = gpio_backend->concurrent_apply;
+    
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, priority > 0 ? SCHED_FIFO : SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    if (cpu >= 0) {
+        cpu_set_t set;
+        
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    
+    atomic_store(&running, 1);
+    err = pthread_create(&thread, &attr, monitor_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start conflict monitor: %s\n", strerror(err));
+        atomic_store(&running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void monitor_stop(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&running, 0);
+    pthread_join(thread, NULL);
+}
+
+int monitor_tripped(void) {
+    return atomic_load_explicit(&tripped, memory_order_relaxed);
+}
+
+int monitor_fault(unsigned int *state) {
+    if (!atomic_load_explicit(&tripped, memory_order_acquire)) return -1;
+    *state = fault_state;
+    return fault_isect;
+}
@@ -0,0 +1,51 @@
+/*
+ * Conflict monitor
+ *
+ * Checks that the lights show what the plans allow, independently of the
+ * control loop. A thread of its own, ideally on a core of its own, reads
+ * the pin levels back through the GPIO backend every MONITOR_PERIOD_US and
+ * turns the six standard heads of each intersection into a 6-bit state.
+ * One load and bit test against a precomputed 64-bit table of the states
+ * its plans allow (plan_set.allowed) checks each intersection.
+ *
+ * A state that is not allowed for MONITOR_CONFIRM samples in a row, so
+ * never the instant between the set and clear writes of a phase change,
+ * trips the monitor. On the mmap and RP1 backends, whose set and clear
+ * stores are safe from two threads, it drives every intersection to
+ * all-red itself: the lights are red within MONITOR_CONFIRM + 1 periods
+ * of the fault, even if the control loop is stuck. It then wakes the loop,
+ * which switches to flash (all-red where there are no flash heads) and
+ * holds it until restart. On gpiod and sim the loop is the only writer,
+ * so there the all-red waits for the loop to wake.
+ *
+ * PWM heads can't be read back and extra heads have no fixed meaning, so
+ * neither is checked. Standard heads on expander pins are refused, so the
+ * monitor's all-red only writes the native pins.
+ */
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stdint.h>
+#include "intersection.h"
+
+#define MONITOR_PERIOD_US   100     // 10 kHz
+#define MONITOR_CONFIRM     3       // Bad samples in a row before tripping
+#define MONITOR_PRIORITY    90      // SCHED_FIFO priority with --realtime, above the loop
+
+// Start monitoring count intersections. cpu >= 0 pins the thread to that
+// CPU; priority > 0 runs it at that SCHED_FIFO priority. Returns 0 on
+// success, -1 after printing an error.
+int monitor_start(const struct intersection *isects, int count, int cpu, int priority);
+
+// Stop the monitor thread
+void monitor_stop(void);
+
+// Non-zero once a conflict has tripped the monitor
+int monitor_tripped(void);
+
+// What tripped it: the intersection and the standard-head state it showed
+// Returns -1 if it has not tripped.
+int monitor_fault(unsigned int *state);
+
+#endif
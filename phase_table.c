@@ -0,0 +1,120 @@
+/*
+ * Traffic light state machine, shared by every controller backend
+ * See phase_table.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "phase_table.h"
+
+#define A_GREEN     HEAD_BIT(HEAD_A_GREEN)
+#define A_YELLOW    HEAD_BIT(HEAD_A_YELLOW)
+#define A_RED       HEAD_BIT(HEAD_A_RED)
+#define B_GREEN     HEAD_BIT(HEAD_B_GREEN)
+#define B_YELLOW    HEAD_BIT(HEAD_B_YELLOW)
+#define B_RED       HEAD_BIT(HEAD_B_RED)
+
+const struct phase_plan default_plan = {
+    .num_phases = 6,
+    .phases = {
+        { A_GREEN  | B_RED,    GREEN_TIME,    0, 0, 1, PHASE_NONE },  // Street A Green, Street B Red
+        { A_YELLOW | B_RED,    YELLOW_TIME,   0, 0, 2, PHASE_NONE },  // Street A Yellow, Street B Red
+        { A_RED    | B_RED,    SAFETY_BUFFER, 0, 0, 3, PHASE_NONE },  // Both Red (safety buffer)
+        { A_RED    | B_GREEN,  GREEN_TIME,    0, 0, 4, PHASE_NONE },  // Street A Red, Street B Green
+        { A_RED    | B_YELLOW, YELLOW_TIME,   0, 0, 5, PHASE_NONE },  // Street A Red, Street B Yellow
+        { A_RED    | B_RED,    SAFETY_BUFFER, 0, 0, 0, PHASE_NONE },  // Both Red (safety buffer)
+    },
+};
+
+const char *const std_head_names[NUM_STD_HEADS] = {
+    "a_red", "a_yellow", "a_green",
+    "b_red", "b_yellow", "b_green"
+};
+
+static int find_head(const char *name, const char *const *head_names, int num_heads) {
+    for (int i = 0; i < num_heads; i++) {
+        if (strcmp(name, head_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+int phase_parse(struct phase_plan *plan, char *args,
+                const char *const *head_names, int num_heads) {
+    struct phase *phase;
+    char *save, *tok, *end;
+    long value;
+    
+    if (plan->num_phases >= MAX_PHASES) return -1;
+    phase = &plan->phases[plan->num_phases];
+    
+    // Duration in milliseconds
+    tok = strtok_r(args, " \t", &save);
+    if (!tok) return -1;
+    value = strtol(tok, &end, 10);
+    if (*end != '\0' || value <= 0 || value > 3600000) return -1;
+    
+    phase->heads = 0;
+    phase->duration_us = (uint32_t)value * 1000;
+    phase->next = plan->num_phases + 1;
+    phase->call = PHASE_NONE;
+    phase->max_us = phase->gap_us = 0;
+    
+    while ((tok = strtok_r(NULL, " \t", &save)) != NULL) {
+        if (strcmp(tok, "next=return") == 0) {
+            phase->next = PHASE_RETURN;
+            continue;
+        }
+        if (strncmp(tok, "next=", 5) == 0) {
+            value = strtol(tok + 5, &end, 10);
+            if (*end != '\0' || value < 0 || value >= MAX_PHASES) return -1;
+            phase->next = (uint8_t)value;
+            continue;
+        }
+        if (strncmp(tok, "max=", 4) == 0 || strncmp(tok, "gap=", 4) == 0) {
+            value = strtol(tok + 4, &end, 10);
+            if (*end != '\0' || value <= 0 || value > 3600000) return -1;
+            if (tok[0] == 'm') phase->max_us = (uint32_t)value * 1000;
+            else phase->gap_us = (uint32_t)value * 1000;
+            continue;
+        }
+        if (strncmp(tok, "call=", 5) == 0) {
+            value = strtol(tok + 5, &end, 10);
+            if (*end != '\0' || value < 0 || value >= MAX_PHASES) return -1;
+            phase->call = (uint8_t)value;
+            continue;
+        }
+        
+        int head = find_head(tok, head_names, num_heads);
+        if (head < 0) return -1;
+        phase->heads |= HEAD_BIT(head);
+    }
+    
+    plan->num_phases++;
+    return 0;
+}
+
+void phase_plan_finish(struct phase_plan *plan) {
+    if (plan->num_phases > 0 && plan->phases[plan->num_phases - 1].next == plan->num_phases) {
+        plan->phases[plan->num_phases - 1].next = 0;
+    }
+}
+
+int phase_plan_validate(const struct phase_plan *plan) {
+    if (plan->num_phases < 1 || plan->num_phases > MAX_PHASES) return -1;
+    
+    for (int i = 0; i < plan->num_phases; i++) {
+        if (plan->phases[i].duration_us == 0) return -1;
+        if (plan->phases[i].next >= plan->num_phases && plan->phases[i].next != PHASE_RETURN) return -1;
+        if (plan->phases[i].call >= plan->num_phases && plan->phases[i].call != PHASE_NONE) return -1;
+        if ((plan->phases[i].max_us == 0) != (plan->phases[i].gap_us == 0)) return -1;
+        if (plan->phases[i].max_us && plan->phases[i].max_us < plan->phases[i].duration_us) return -1;
+    }
+    return 0;
+}
+
+const char *street_color(head_mask_t heads, int red_head) {
+    if (heads & HEAD_BIT(red_head + 2)) return "GREEN";
+    if (heads & HEAD_BIT(red_head + 1)) return "YELLOW";
+    if (heads & HEAD_BIT(red_head)) return "RED";
+    return "OFF";
+}
@@ -0,0 +1,90 @@
+/*
+ * Traffic light state machine, shared by every controller backend
+ *
+ * A plan is a small table of phases. Each phase lists the signal heads
+ * that are lit, how long the phase lasts and which phase follows it.
+ * Controllers walk the table instead of hard-coding the sequence, so new
+ * phases (protected left turns, pedestrian intervals, ...) are a change to
+ * the table rather than to the control loop.
+ */
+
+#ifndef PHASE_TABLE_H
+#define PHASE_TABLE_H
+
+#include <stdint.h>
+
+// Signal heads of the standard two-way intersection
+enum {
+    HEAD_A_RED,
+    HEAD_A_YELLOW,
+    HEAD_A_GREEN,
+    HEAD_B_RED,
+    HEAD_B_YELLOW,
+    HEAD_B_GREEN,
+    NUM_STD_HEADS
+};
+
+#define MAX_HEADS       32
+#define MAX_PHASES      32
+
+// One bit per signal head
+typedef uint32_t head_mask_t;
+#define HEAD_BIT(head)  ((head_mask_t)1 << (head))
+
+// Special phase indices
+#define PHASE_NONE      0xff    // call: this phase is not a safe point
+#define PHASE_RETURN    0xfe    // next: go back to where the call was taken
+
+// Standard timing (in microseconds)
+#define GREEN_TIME      5000000   // 5 seconds
+#define YELLOW_TIME     1000000   // 1 second
+#define SAFETY_BUFFER   1000000   // 1 second both red
+
+struct phase {
+    head_mask_t heads;      // Heads lit during this phase
+    uint32_t duration_us;   // How long the phase lasts (minimum if actuated)
+    uint32_t max_us;        // Actuated: longest the phase may be extended to
+    uint32_t gap_us;        // Actuated: extension per detector pulse, 0 = fixed
+    uint8_t next;           // Index of the phase that follows
+    uint8_t call;           // Phase entered instead of next while a
+                            // pedestrian call is waiting, or PHASE_NONE
+};
+
+// Phase 0 starts a new cycle
+struct phase_plan {
+    int num_phases;
+    struct phase phases[MAX_PHASES];
+};
+
+// The six-phase cycle described in TRAFFIC_LIGHT_SETUP.md
+extern const struct phase_plan default_plan;
+
+// Config-file names of the standard heads, in head order
+extern const char *const std_head_names[NUM_STD_HEADS];
+
+// Append a phase parsed from the arguments of a "phase" config line:
+//   <duration_ms> <head>... [next=<index>|return] [call=<index>]
+//                           [max=<ms> gap=<ms>]
+// Heads are looked up in head_names. Without next=, the phase is followed
+// by the one after it. call= marks a safe point for a pedestrian interval:
+// when a button was pressed, the plan continues at call instead of next,
+// and a later phase with next=return resumes at this phase's next.
+// max= and gap= make the phase actuated: it lasts at least duration, each
+// detector pulse for one of its heads holds it gap longer, and it never
+// lasts longer than max. Returns 0 on success, -1 on a malformed line.
+int phase_parse(struct phase_plan *plan, char *args,
+                const char *const *head_names, int num_heads);
+
+// Wrap the last phase of a parsed plan back to phase 0 if it has no next=
+void phase_plan_finish(struct phase_plan *plan);
+
+// Check that a plan is non-empty, every duration is non-zero, every next
+// and call index is in range and every actuated phase has max >=
+// duration. Returns 0 if valid, -1 otherwise.
+int phase_plan_validate(const struct phase_plan *plan);
+
+// Name of the color shown by a red/yellow/green head group in a phase,
+// e.g. street_color(heads, HEAD_A_RED) for Street A
+const char *street_color(head_mask_t heads, int red_head);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Drift-free phase timing for the traffic light controllers
+ * See phase_timer.h
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <sys/timex.h>
+#include "phase_timer.h"
+
+#define NSEC_PER_SEC    1000000000ULL
+#define NSEC_PER_USEC   1000ULL
+
+static int virtual_clock;
+static uint64_t virtual_now_ns;
+static int64_t virtual_real_offset_ns;    // Wall-clock time the virtual clock started at
+
+void clock_use_virtual(void) {
+    virtual_real_offset_ns = clock_realtime_offset_ns() + (int64_t)clock_now_ns();
+    virtual_clock = 1;
+    virtual_now_ns = 0;
+}
+
+int clock_is_virtual(void) {
+    return virtual_clock;
+}
+
+uint64_t clock_now_ns(void) {
+    struct timespec ts;
+    
+    if (virtual_clock) return virtual_now_ns;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+int64_t clock_realtime_offset_ns(void) {
+    struct timespec real, mono;
+    
+    if (virtual_clock) return virtual_real_offset_ns;
+    
+    // Both are vDSO reads, back to back
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    return ((int64_t)real.tv_sec - mono.tv_sec) * (int64_t)NSEC_PER_SEC + (real.tv_nsec - mono.tv_nsec);
+}
+
+int clock_realtime_synced(void) {
+    struct timex tx = { .modes = 0 };
+    
+    // Read-only query; chronyd, ntpd and phc2sys all maintain STA_UNSYNC
+    return adjtimex(&tx) != TIME_ERROR && !(tx.status & STA_UNSYNC);
+}
+
+int sleep_until_ns(uint64_t deadline_ns) {
+    struct timespec ts = {
+        .tv_sec = deadline_ns / NSEC_PER_SEC,
+        .tv_nsec = deadline_ns % NSEC_PER_SEC,
+    };
+    int err;
+    
+    // Fast-forward: no sleeping, time simply moves to the deadline
+    if (virtual_clock) {
+        if (deadline_ns > virtual_now_ns) virtual_now_ns = deadline_ns;
+        return 0;
+    }
+    
+    // clock_nanosleep() returns the error instead of setting errno
+    err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    return err == 0 ? 0 : -1;
+}
+
+void phase_timer_start(struct phase_timer *timer) {
+    timer->epoch_ns = clock_now_ns();
+    timer->deadline_ns = timer->epoch_ns;
+}
+
+int phase_timer_wait(struct phase_timer *timer, uint32_t duration_us) {
+    // Deadlines follow the plan, not the time the phase actually started
+    timer->deadline_ns += (uint64_t)duration_us * NSEC_PER_USEC;
+    return sleep_until_ns(timer->deadline_ns);
+}
@@ -0,0 +1,51 @@
+/*
+ * Drift-free phase timing for the traffic light controllers
+ *
+ * Phase deadlines are absolute points on CLOCK_MONOTONIC, measured from
+ * the epoch the cycle was started at. Each wait advances the deadline by
+ * the phase duration and sleeps until it with clock_nanosleep(TIMER_ABSTIME),
+ * so time spent switching lights or printing never accumulates.
+ */
+
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+#include <stdint.h>
+
+struct phase_timer {
+    uint64_t epoch_ns;      // When the first phase started
+    uint64_t deadline_ns;   // When the current phase ends
+};
+
+// Current CLOCK_MONOTONIC time in nanoseconds
+uint64_t clock_now_ns(void);
+
+// CLOCK_REALTIME minus CLOCK_MONOTONIC right now, for converting between
+// the two. Follows any step or slew NTP/PTP applies to the wall clock.
+// On the virtual clock, simulated time starts at the wall-clock time
+// clock_use_virtual() was called.
+int64_t clock_realtime_offset_ns(void);
+
+// Non-zero if the kernel reports CLOCK_REALTIME as synchronised (NTP/PTP)
+int clock_realtime_synced(void);
+
+// Sleep until an absolute CLOCK_MONOTONIC time
+// Returns 0 once the time is reached, -1 if interrupted by a signal
+int sleep_until_ns(uint64_t deadline_ns);
+
+// Switch to a virtual clock for simulation: time starts at 0, stands
+// still while the program works, and sleep_until_ns() jumps straight to
+// the deadline, so simulated days run as fast as the CPU allows.
+void clock_use_virtual(void);
+
+// Non-zero if the virtual clock is in use
+int clock_is_virtual(void);
+
+// Start the cycle epoch at the current time
+void phase_timer_start(struct phase_timer *timer);
+
+// End the current phase duration_us after the previous deadline and sleep
+// until then. Returns 0 on time, -1 if interrupted by a signal.
+int phase_timer_wait(struct phase_timer *timer, uint32_t duration_us);
+
+#endif
@@ -0,0 +1,508 @@
+/*
+ * Timing-plan optimiser
+ * Finds the green, yellow and all-red times with the least delay for the
+ * detector demand in a trace recorded by stoplight --record
+ *
+ * Compile: see CMakeLists.txt (target "stoplight_optimize")
+ * Run: ./stoplight_optimize [options] <trace-file> <config-file>
+ *
+ * Each intersection with detectors is modelled as one queue per street.
+ * Every detector pulse in the trace is a vehicle joining the queue of the
+ * street its head belongs to, and a queue discharges at the saturation
+ * flow while its street is green, after a start-up lost time. Delay is
+ * the queue length summed over 100 ms ticks. Every six-phase plan on the
+ * grid of --green, --yellow and --clear times is run against the whole
+ * trace, and the one with the least delay is printed as phase lines.
+ * With --out the config file is written again with those lines in place
+ * of each intersection's default plan, ready for a restart or SIGHUP.
+ *
+ * Candidates are kept as structure-of-arrays, so one tick of the model is
+ * the same few branch-free operations on every candidate of a block,
+ * which the compiler turns into SIMD (NEON on the Pi, SSE/AVX on a PC).
+ * Blocks are handed out to one thread per CPU.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gpio_backend.h"
+#include "input_trace.h"
+#include "intersection.h"
+
+#define TICK_MS             100     // Model resolution; every time is a multiple
+#define TICK_NS             ((uint64_t)TICK_MS * 1000000)
+#define MAX_CANDIDATES      65536
+#define BLOCK               512     // Candidates per work item: a few KB of state per thread
+#define FOLD_TICKS          1024    // Ticks summed in float before adding to the double total
+#define MAX_THREADS         64
+
+// A grid of times in ms
+struct range {
+    unsigned int min_ms, max_ms, step_ms;
+};
+
+static struct range green = { 5000, 60000, 1000 };
+static struct range yellow = { 3000, 5000, 500 };
+static struct range clear = { 1000, 3000, 1000 };
+static float saturation = 0.5f;         // Vehicles per second leaving a green street
+static unsigned int lost_ms = 2000;     // Start-up lost time at the start of a green
+
+// The candidates, one array per field. A street discharges while the
+// tick into the cycle is in [from, to).
+static struct {
+    int count;
+    uint32_t green_a_ms[MAX_CANDIDATES], green_b_ms[MAX_CANDIDATES];
+    uint32_t yellow_ms[MAX_CANDIDATES], clear_ms[MAX_CANDIDATES];
+    uint32_t a_from[MAX_CANDIDATES], a_to[MAX_CANDIDATES];
+    uint32_t b_from[MAX_CANDIDATES], b_to[MAX_CANDIDATES];
+    uint32_t cycle[MAX_CANDIDATES];     // Ticks
+    double delay[MAX_CANDIDATES];       // Vehicle-seconds over the trace
+} cand;
+
+// Arrivals per tick of the intersection being optimised
+static struct {
+    size_t ticks;
+    float *street[2];                   // Street A, street B
+    uint64_t vehicles[2];
+} demand;
+
+static atomic_int next_block;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <trace-file> <config-file>\n", prog);
+    fprintf(stderr, "  -g, --green MIN:MAX:STEP    Green times to try per street, ms (default %u:%u:%u)\n",
+            green.min_ms, green.max_ms, green.step_ms);
+    fprintf(stderr, "  -y, --yellow MIN:MAX:STEP   Yellow times to try, ms (default %u:%u:%u)\n",
+            yellow.min_ms, yellow.max_ms, yellow.step_ms);
+    fprintf(stderr, "  -c, --clear MIN:MAX:STEP    All-red times to try, ms (default %u:%u:%u)\n",
+            clear.min_ms, clear.max_ms, clear.step_ms);
+    fprintf(stderr, "  -s, --saturation VEH_S      Discharge rate of a green street (default %.2f)\n",
+            saturation);
+    fprintf(stderr, "  -l, --lost MS               Start-up lost time per green (default %u)\n", lost_ms);
+    fprintf(stderr, "  -j, --threads N             Worker threads (default: one per CPU)\n");
+    fprintf(stderr, "  -o, --out FILE              Write the config with the best plans to FILE\n");
+}
+
+static int parse_range(const char *arg, struct range *r) {
+    char tail;
+    
+    if (sscanf(arg, "%u:%u:%u%c", &r->min_ms, &r->max_ms, &r->step_ms, &tail) != 3 ||
+        r->step_ms == 0 || r->min_ms == 0 || r->min_ms > r->max_ms ||
+        r->min_ms % TICK_MS || r->step_ms % TICK_MS) {
+        fprintf(stderr, "Expected MIN:MAX:STEP in ms, multiples of %d: %s\n", TICK_MS, arg);
+        return -1;
+    }
+    return 0;
+}
+
+// Fill in every plan on the grid
+static int build_candidates(void) {
+    uint32_t lost = lost_ms / TICK_MS;
+    
+    cand.count = 0;
+    for (unsigned int ga = green.min_ms; ga <= green.max_ms; ga += green.step_ms) {
+        for (unsigned int gb = green.min_ms; gb <= green.max_ms; gb += green.step_ms) {
+            for (unsigned int y = yellow.min_ms; y <= yellow.max_ms; y += yellow.step_ms) {
+                for (unsigned int r = clear.min_ms; r <= clear.max_ms; r += clear.step_ms) {
+                    int c = cand.count++;
+    
+                    if (c == MAX_CANDIDATES) {
+                        fprintf(stderr, "More than %d candidate plans; use a coarser grid\n", MAX_CANDIDATES);
+                        return -1;
+                    }
+                    cand.green_a_ms[c] = ga;
+                    cand.green_b_ms[c] = gb;
+                    cand.yellow_ms[c] = y;
+                    cand.clear_ms[c] = r;
+                    cand.a_from[c] = lost;
+                    cand.a_to[c] = ga / TICK_MS;
+                    cand.b_from[c] = (ga + y + r) / TICK_MS + lost;
+                    cand.b_to[c] = (ga + y + r + gb) / TICK_MS;
+                    cand.cycle[c] = (ga + gb + 2 * y + 2 * r) / TICK_MS;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Run candidates [first, first + n) against the whole of demand
+static void run_block(int first, int n) {
+    const uint32_t *restrict a_from = cand.a_from + first, *restrict a_to = cand.a_to + first;
+    const uint32_t *restrict b_from = cand.b_from + first, *restrict b_to = cand.b_to + first;
+    const uint32_t *restrict cycle = cand.cycle + first;
+    const float sat = saturation * TICK_MS / 1000.0f;
+    uint32_t pos[BLOCK] = { 0 };
+    float qa[BLOCK] = { 0 }, qb[BLOCK] = { 0 }, acc[BLOCK] = { 0 };
+    double sum[BLOCK] = { 0 };
+    
+    for (size_t t = 0; t < demand.ticks; t++) {
+        const float in_a = demand.street[0][t], in_b = demand.street[1][t];
+    
+        // The hot loop: no branches, so it vectorises
+        for (int c = 0; c < n; c++) {
+            uint32_t p = pos[c], next = p + 1;
+            float a = qa[c] + in_a - sat * (float)((p >= a_from[c]) & (p < a_to[c]));
+            float b = qb[c] + in_b - sat * (float)((p >= b_from[c]) & (p < b_to[c]));
+            
+            a = a < 0.0f ? 0.0f : a;
+            b = b < 0.0f ? 0.0f : b;
+            qa[c] = a;
+            qb[c] = b;
+            acc[c] += a + b;
+            pos[c] = next * (next != cycle[c]);
+        }
+    
+        if ((t + 1) % FOLD_TICKS == 0) {
+            for (int c = 0; c < n; c++) {
+                sum[c] += acc[c];
+                acc[c] = 0.0f;
+            }
+        }
+    }
+    for (int c = 0; c < n; c++) cand.delay[first + c] = (sum[c] + acc[c]) * TICK_MS / 1000.0;
+}
+
+static void *worker(void *arg) {
+    int block;
+    
+    while ((block = atomic_fetch_add(&next_block, 1)) * BLOCK < cand.count) {
+        int first = block * BLOCK, n = cand.count - first < BLOCK ? cand.count - first : BLOCK;
+    
+        run_block(first, n);
+    }
+    return NULL;
+}
+
+// Evaluate every candidate on num_threads threads. Returns the best one.
+static int evaluate(int num_threads) {
+    pthread_t threads[MAX_THREADS];
+    int started = 0, best = 0;
+    
+    atomic_store(&next_block, 0);
+    for (; started < num_threads; started++) {
+        if (pthread_create(&threads[started], NULL, worker, NULL) != 0) break;
+    }
+    if (started == 0) worker(NULL);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    
+    for (int c = 1; c < cand.count; c++) {
+        if (cand.delay[c] < cand.delay[best]) best = c;
+    }
+    return best;
+}
+
+// Ticks a phase lasts, at least one
+static uint64_t phase_ticks(const struct phase *ph) {
+    uint64_t ticks = (ph->duration_us + TICK_MS * 500) / (TICK_MS * 1000);
+    
+    return ticks ? ticks : 1;
+}
+
+// The same model, one tick at a time, for a plan as it stands: fixed-time,
+// without calls or extensions
+static double plan_delay(const struct phase_plan *plan) {
+    const float sat = saturation * TICK_MS / 1000.0f;
+    uint32_t lost = lost_ms / TICK_MS, run[2] = { 0, 0 };
+    float queue[2] = { 0.0f, 0.0f };
+    double sum = 0;
+    int phase = 0;
+    uint64_t left = phase_ticks(&plan->phases[0]);
+    
+    for (size_t t = 0; t < demand.ticks; t++) {
+        head_mask_t heads = plan->phases[phase].heads;
+    
+        for (int s = 0; s < 2; s++) {
+            run[s] = heads & HEAD_BIT(s ? HEAD_B_GREEN : HEAD_A_GREEN) ? run[s] + 1 : 0;
+            queue[s] += demand.street[s][t];
+            if (run[s] > lost) queue[s] = queue[s] > sat ? queue[s] - sat : 0.0f;
+            sum += queue[s];
+        }
+        if (--left == 0) {
+            uint8_t next = plan->phases[phase].next;
+    
+            phase = next == PHASE_RETURN ? 0 : next;
+            left = phase_ticks(&plan->phases[phase]);
+        }
+    }
+    return sum * TICK_MS / 1000.0;
+}
+
+// Street (0 = A, 1 = B) held by the detector on pin, or -1
+static int street_of(const struct intersection *isect, unsigned int pin) {
+    for (int d = 0; d < isect->num_detectors; d++) {
+        int head = isect->detectors[d].head;
+    
+        if (isect->detectors[d].pin == pin && head < NUM_STD_HEADS) return head >= HEAD_B_RED;
+    }
+    return -1;
+}
+
+// Bin the detector pulses of one intersection into ticks
+static void load_demand(const uint8_t *map, size_t size, const struct intersection *isect) {
+    size_t off = sizeof(struct trace_header);
+    uint64_t start = 0;
+    
+    demand.vehicles[0] = demand.vehicles[1] = 0;
+    memset(demand.street[0], 0, demand.ticks * sizeof(float));
+    memset(demand.street[1], 0, demand.ticks * sizeof(float));
+    while (off + sizeof(struct trace_record) <= size) {
+        const struct trace_record *rec = (const struct trace_record *)(map + off);
+        const struct gpio_input_event *events = (const struct gpio_input_event *)(rec + 1);
+    
+        if (off + sizeof(*rec) + ((rec->len + 7u) & ~7u) > size) break;
+        if (off == sizeof(struct trace_header)) start = rec->time_ns;
+        off += sizeof(*rec) + ((rec->len + 7u) & ~7u);
+        if (rec->type != TRACE_DETECTORS) continue;
+    
+        for (size_t i = 0; i < rec->len / sizeof(*events); i++) {
+            int s = street_of(isect, events[i].pin);
+            uint64_t tick = events[i].time_ns > start ? (events[i].time_ns - start) / TICK_NS : 0;
+    
+            if (s < 0) continue;
+            if (tick >= demand.ticks) tick = demand.ticks - 1;
+            demand.street[s][tick] += 1.0f;
+            demand.vehicles[s]++;
+        }
+    }
+}
+
+// How long the trace runs, between its first and last whole record
+static uint64_t trace_span(const uint8_t *map, size_t size) {
+    size_t off = sizeof(struct trace_header);
+    uint64_t first = 0, last = 0;
+    
+    while (off + sizeof(struct trace_record) <= size) {
+        const struct trace_record *rec = (const struct trace_record *)(map + off);
+    
+        if (off + sizeof(*rec) + ((rec->len + 7u) & ~7u) > size) break;
+        if (off == sizeof(struct trace_header)) first = rec->time_ns;
+        last = rec->time_ns;
+        off += sizeof(*rec) + ((rec->len + 7u) & ~7u);
+    }
+    return last - first;
+}
+
+// The six phase lines of candidate c
+static void print_plan(FILE *fp, int c) {
+    fprintf(fp, "    phase %u a_green b_red\n", cand.green_a_ms[c]);
+    fprintf(fp, "    phase %u a_yellow b_red\n", cand.yellow_ms[c]);
+    fprintf(fp, "    phase %u a_red b_red\n", cand.clear_ms[c]);
+    fprintf(fp, "    phase %u a_red b_green\n", cand.green_b_ms[c]);
+    fprintf(fp, "    phase %u a_red b_yellow\n", cand.yellow_ms[c]);
+    fprintf(fp, "    phase %u a_red b_red\n", cand.clear_ms[c]);
+}
+
+// Copy the config to out_path with the default plan of every intersection
+// i with best[i] >= 0 replaced by that candidate
+static int write_config(const char *in_path, const char *out_path, const int *best) {
+    FILE *in = fopen(in_path, "r"), *out;
+    char line[256];
+    int isect = -1, replacing = 0, written = 0;
+    
+    if (!in) {
+        perror(in_path);
+        return -1;
+    }
+    out = fopen(out_path, "w");
+    if (!out) {
+        perror(out_path);
+        fclose(in);
+        return -1;
+    }
+    
+    while (fgets(line, sizeof(line), in)) {
+        char copy[256], *save, *key;
+    
+        snprintf(copy, sizeof(copy), "%s", line);
+        copy[strcspn(copy, "#\n")] = '\0';
+        key = strtok_r(copy, " \t", &save);
+        if (!key) key = "";
+    
+        // The new lines go where the old ones were, or at the end of a
+        // default plan that had none
+        if (replacing && !written && (strcmp(key, "phase") == 0 || strcmp(key, "plan") == 0 ||
+                                      strcmp(key, "intersection") == 0)) {
+            print_plan(out, best[isect]);
+            written = 1;
+        }
+        if (strcmp(key, "intersection") == 0) {
+            isect++;
+            replacing = best[isect] >= 0;
+            written = 0;
+        } else if (strcmp(key, "plan") == 0) {
+            replacing = 0;
+        } else if (strcmp(key, "phase") == 0 && replacing) {
+            continue;
+        }
+        fputs(line, out);
+    }
+    if (replacing && !written) print_plan(out, best[isect]);
+    
+    fclose(in);
+    if (fclose(out) != 0) {
+        perror(out_path);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        { "green",      required_argument, NULL, 'g' },
+        { "yellow",     required_argument, NULL, 'y' },
+        { "clear",      required_argument, NULL, 'c' },
+        { "saturation", required_argument, NULL, 's' },
+        { "lost",       required_argument, NULL, 'l' },
+        { "threads",    required_argument, NULL, 'j' },
+        { "out",        required_argument, NULL, 'o' },
+        { "help",       no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    static struct intersection isects[MAX_INTERSECTIONS];
+    const struct trace_header *h;
+    const char *out_path = NULL;
+    int best[MAX_INTERSECTIONS], count, opt, num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN), found = 0;
+    struct stat st;
+    const uint8_t *map;
+    void *m;
+    int fd;
+    
+    while ((opt = getopt_long(argc, argv, "g:y:c:s:l:j:o:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'g':
+            if (parse_range(optarg, &green) != 0) return 1;
+            break;
+        case 'y':
+            if (parse_range(optarg, &yellow) != 0) return 1;
+            break;
+        case 'c':
+            if (parse_range(optarg, &clear) != 0) return 1;
+            break;
+        case 's':
+            saturation = atof(optarg);
+            if (saturation <= 0) {
+                fprintf(stderr, "Saturation flow must be above 0 vehicles per second\n");
+                return 1;
+            }
+            break;
+        case 'l':
+            lost_ms = atoi(optarg);
+            break;
+        case 'j':
+            num_threads = atoi(optarg);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (lost_ms % TICK_MS || lost_ms >= green.min_ms) {
+        fprintf(stderr, "Lost time must be a multiple of %d ms and shorter than the shortest green\n", TICK_MS);
+        return 1;
+    }
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+    
+    count = intersections_load(argv[optind + 1], isects, MAX_INTERSECTIONS);
+    if (count < 0) return 1;
+    
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if ((size_t)st.st_size < sizeof(*h)) {
+        fprintf(stderr, "%s: not a stoplight input trace\n", argv[optind]);
+        return 1;
+    }
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        perror("mmap error");
+        return 1;
+    }
+    map = m;
+    h = m;
+    if (memcmp(h->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || h->version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a stoplight input trace (or a different version)\n", argv[optind]);
+        return 1;
+    }
+    if (h->num_isects != (uint32_t)count || h->layout != input_trace_layout(isects, count)) {
+        fprintf(stderr, "%s was recorded with a different config\n", argv[optind]);
+        return 1;
+    }
+    
+    demand.ticks = trace_span(map, st.st_size) / TICK_NS + 1;
+    demand.street[0] = malloc(demand.ticks * sizeof(float));
+    demand.street[1] = malloc(demand.ticks * sizeof(float));
+    if (!demand.street[0] || !demand.street[1]) {
+        perror("malloc");
+        return 1;
+    }
+    if (build_candidates() != 0) return 1;
+    
+    printf("Trace: %.0f s; %d candidate plans per intersection on %d thread%s\n",
+           demand.ticks * TICK_MS / 1000.0, cand.count, num_threads, num_threads == 1 ? "" : "s");
+    for (int i = 0; i < count; i++) {
+        const struct intersection *isect = &isects[i];
+        struct timespec t0, t1;
+        double was, secs;
+        uint64_t vehicles;
+        int c;
+    
+        best[i] = -1;
+        if (isect->num_heads > NUM_STD_HEADS) {
+            printf("\n%s: skipped, only plans of the six standard heads are generated\n", isect->name);
+            continue;
+        }
+        load_demand(map, st.st_size, isect);
+        vehicles = demand.vehicles[0] + demand.vehicles[1];
+        if (vehicles == 0) {
+            printf("\n%s: skipped, no detector pulses in the trace\n", isect->name);
+            continue;
+        }
+    
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        c = evaluate(num_threads);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        was = plan_delay(&isect->sets[0].plans[0].plan);
+        best[i] = c;
+        found = 1;
+    
+        printf("\n%s: %llu vehicles on street A, %llu on street B\n", isect->name,
+               (unsigned long long)demand.vehicles[0], (unsigned long long)demand.vehicles[1]);
+        printf("  current plan: %10.0f vehicle-s delay, %6.1f s per vehicle\n", was, was / vehicles);
+        printf("  best plan:    %10.0f vehicle-s delay, %6.1f s per vehicle (%.1f%% less)\n",
+               cand.delay[c], cand.delay[c] / vehicles, was > 0 ? 100.0 * (was - cand.delay[c]) / was : 0.0);
+        printf("  (%.2f s, %.0f million candidate-ticks per second)\n", secs,
+               cand.count * (double)demand.ticks / secs / 1e6);
+        print_plan(stdout, c);
+    }
+    if (!found) {
+        fprintf(stderr, "No intersection had detector demand to optimise for\n");
+        return 1;
+    }
+    
+    if (out_path) {
+        if (write_config(argv[optind + 1], out_path, best) != 0) return 1;
+        printf("\nWrote %s; load it with a restart, or copy it over the config and send SIGHUP\n", out_path);
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Hot reload of timing plans
+ * See plan_reload.h
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include "event_loop.h"
+#include "plan_reload.h"
+
+static const char *config_path;
+static struct intersection *isects;
+static int num_isects;
+
+// Parsed off the control thread; only the reload thread touches it
+static struct intersection staged[MAX_INTERSECTIONS];
+
+static atomic_int running;
+static pthread_t thread;
+
+// Woken once per request; requests made while a reload runs coalesce
+static struct event_loop loop = EVENT_LOOP_CLOSED;
+
+// Everything but the phases must match what the lines were set up for
+static int same_layout(const struct intersection *a, const struct intersection *b) {
+    if (strcmp(a->name, b->name) != 0 || a->num_heads != b->num_heads ||
+        a->num_buttons != b->num_buttons || a->num_detectors != b->num_detectors ||
+        a->num_pwm != b->num_pwm || a->flash_heads != b->flash_heads || a->offset_ns != b->offset_ns ||
+        a->set->num_plans != b->set->num_plans) {
+        return 0;
+    }
+    
+    // The calendar refers to plans by index
+    for (int i = 0; i < a->set->num_plans; i++) {
+        if (strcmp(a->set->names[i], b->set->names[i]) != 0) return 0;
+    }
+    if (memcmp(a->pins, b->pins, a->num_heads * sizeof(a->pins[0])) != 0 ||
+        memcmp(a->buttons, b->buttons, a->num_buttons * sizeof(a->buttons[0])) != 0) {
+        return 0;
+    }
+    for (int head = 0; head < a->num_heads; head++) {
+        if (strcmp(a->head_names[head], b->head_names[head]) != 0) return 0;
+    }
+    for (int i = 0; i < a->num_detectors; i++) {
+        if (a->detectors[i].pin != b->detectors[i].pin || a->detectors[i].head != b->detectors[i].head) return 0;
+    }
+    for (int i = 0; i < a->num_pwm; i++) {
+        if (a->pwm[i].head != b->pwm[i].head || a->pwm[i].pwm.chip != b->pwm[i].pwm.chip ||
+            a->pwm[i].pwm.channel != b->pwm[i].pwm.channel) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void reload(void) {
+    int count = intersections_load(config_path, staged, MAX_INTERSECTIONS);
+    
+    if (count < 0) {
+        fprintf(stderr, "\nReload of %s failed; keeping the running plans\n", config_path);
+        return;
+    }
+    if (count != num_isects) {
+        fprintf(stderr, "\nReload of %s: intersections added or removed; restart to apply\n", config_path);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!same_layout(&isects[i], &staged[i])) {
+            fprintf(stderr, "\nReload of %s: intersection %s changed more than its phases; restart to apply\n",
+                    config_path, staged[i].name);
+            return;
+        }
+    }
+    
+    // The spare is free only once the loop has taken the last reload
+    for (int i = 0; i < count; i++) {
+        if (atomic_load_explicit(&isects[i].pending, memory_order_acquire)) {
+            fprintf(stderr, "\nReload of %s: previous plans not in use yet; try again next cycle\n",
+                    config_path);
+            return;
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        struct intersection *isect = &isects[i];
+        struct plan_set *spare = isect->set == &isect->sets[0] ? &isect->sets[1] : &isect->sets[0];
+        
+        // Everything but allowed, which the monitor reads meanwhile;
+        // intersection_build_set() stores it in one go
+        memcpy(spare, &staged[i].sets[0], offsetof(struct plan_set, allowed));
+        intersection_build_set(isect, spare);
+        atomic_store_explicit(&isect->pending, spare, memory_order_release);
+    }
+    printf("\nReloaded plans from %s; each intersection switches at its next cycle\n", config_path);
+}
+
+static void *reload_thread(void *arg) {
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        if (!(event_loop_wait(&loop, EVENT_NEVER) & EVENT_BIT(EVENT_WAKE))) continue;
+        
+        // plan_reload_stop() wakes the thread too
+        if (atomic_load_explicit(&running, memory_order_relaxed)) reload();
+    }
+    return NULL;
+}
+
+int plan_reload_start(const char *path, struct intersection *list, int count) {
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_t attr;
+    int err;
+    
+    config_path = path;
+    isects = list;
+    num_isects = count;
+    if (event_loop_open(&loop, NULL) != 0) return -1;
+    
+    // Parsing can take as long as it likes
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    
+    atomic_store(&running, 1);
+    err = pthread_create(&thread, &attr, reload_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start plan reload thread: %s\n", strerror(err));
+        atomic_store(&running, 0);
+        event_loop_close(&loop);
+        return -1;
+    }
+    return 0;
+}
+
+void plan_reload_request(void) {
+    event_loop_wake(&loop);
+}
+
+void plan_reload_stop(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&running, 0);
+    event_loop_wake(&loop);
+    pthread_join(thread, NULL);
+    event_loop_close(&loop);
+}
@@ -0,0 +1,31 @@
+/*
+ * Hot reload of timing plans
+ *
+ * On request (SIGHUP) a normal-priority thread re-reads the config file
+ * the controller was started with, parses and validates it off the
+ * control thread, and builds a fresh plan_set for every intersection in
+ * its spare slot. Each new set is handed to the control loop with one
+ * atomic pointer store; the loop switches at the intersection's next
+ * cycle boundary, so retiming never touches the lines or the hot path.
+ *
+ * Only phase lines may change. A file that changes the wiring, the
+ * intersections, their offsets or their plan names, or that fails to
+ * parse, is rejected and the running plans carry on.
+ */
+
+#ifndef PLAN_RELOAD_H
+#define PLAN_RELOAD_H
+
+#include "intersection.h"
+
+// Start the reload thread for the count intersections loaded from path
+// Returns 0 on success, -1 after printing an error.
+int plan_reload_start(const char *path, struct intersection *isects, int count);
+
+// Ask for a reload. Safe to call from any thread and from signal handlers.
+void plan_reload_request(void);
+
+// Stop the reload thread
+void plan_reload_stop(void);
+
+#endif
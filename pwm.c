@@ -0,0 +1,103 @@
+/*
+ * Hardware PWM channels through the kernel pwm sysfs interface
+ * See pwm.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "pwm.h"
+
+#define PWM_SYSFS       "/sys/class/pwm"
+#define EXPORT_WAIT_MS  200     // udev needs a moment to set permissions
+
+static int simulate;
+
+void pwm_simulate(void) {
+    simulate = 1;
+}
+
+static int write_value(int fd, uint64_t value) {
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value);
+    
+    if (simulate) return 0;
+    return pwrite(fd, buf, len, 0) == len ? 0 : -1;
+}
+
+static int open_attr(const struct pwm_channel *pwm, const char *attr) {
+    char path[96];
+    
+    snprintf(path, sizeof(path), PWM_SYSFS "/pwmchip%u/pwm%u/%s", pwm->chip, pwm->channel, attr);
+    return open(path, O_WRONLY);
+}
+
+int pwm_open(struct pwm_channel *pwm, unsigned int chip, unsigned int channel) {
+    const struct timespec ms = { .tv_sec = 0, .tv_nsec = 1000000 };
+    char path[96];
+    
+    pwm->chip = chip;
+    pwm->channel = channel;
+    pwm->period_fd = pwm->duty_fd = pwm->enable_fd = -1;
+    pwm->period_ns = pwm->duty_ns = 0;
+    if (simulate) return 0;
+    
+    // Export the channel unless an earlier run already did
+    snprintf(path, sizeof(path), PWM_SYSFS "/pwmchip%u/pwm%u", chip, channel);
+    if (access(path, F_OK) != 0) {
+        FILE *fp;
+        
+        snprintf(path, sizeof(path), PWM_SYSFS "/pwmchip%u/export", chip);
+        fp = fopen(path, "w");
+        if (!fp || fprintf(fp, "%u\n", channel) < 0 || fclose(fp) != 0) {
+            fprintf(stderr, "Cannot export PWM %u on pwmchip%u: %s\n", channel, chip, strerror(errno));
+            return -1;
+        }
+    }
+    
+    for (int i = 0; i < EXPORT_WAIT_MS && pwm->enable_fd < 0; i++) {
+        pwm->enable_fd = open_attr(pwm, "enable");
+        if (pwm->enable_fd < 0) nanosleep(&ms, NULL);
+    }
+    pwm->period_fd = open_attr(pwm, "period");
+    pwm->duty_fd = open_attr(pwm, "duty_cycle");
+    if (pwm->enable_fd < 0 || pwm->period_fd < 0 || pwm->duty_fd < 0) {
+        fprintf(stderr, "Cannot open PWM %u on pwmchip%u: %s\n", channel, chip, strerror(errno));
+        pwm_close(pwm);
+        return -1;
+    }
+    return 0;
+}
+
+int pwm_set(struct pwm_channel *pwm, uint64_t period_ns, uint64_t duty_ns) {
+    int enable_now = pwm->period_ns == 0;
+    
+    if (period_ns == pwm->period_ns && duty_ns == pwm->duty_ns) return 0;
+    
+    // The kernel rejects a duty longer than the period at every step
+    if (period_ns != pwm->period_ns) {
+        if (duty_ns < pwm->duty_ns && write_value(pwm->duty_fd, duty_ns) != 0) return -1;
+        if (write_value(pwm->period_fd, period_ns) != 0) return -1;
+        pwm->period_ns = period_ns;
+    }
+    if (duty_ns != pwm->duty_ns || enable_now) {
+        if (write_value(pwm->duty_fd, duty_ns) != 0) return -1;
+        pwm->duty_ns = duty_ns;
+    }
+    if (enable_now && write_value(pwm->enable_fd, 1) != 0) return -1;
+    return 0;
+}
+
+void pwm_close(struct pwm_channel *pwm) {
+    if (pwm->enable_fd >= 0) {
+        write_value(pwm->enable_fd, 0);
+        close(pwm->enable_fd);
+    }
+    if (pwm->period_fd >= 0) close(pwm->period_fd);
+    if (pwm->duty_fd >= 0) close(pwm->duty_fd);
+    pwm->period_fd = pwm->duty_fd = pwm->enable_fd = -1;
+    pwm->period_ns = pwm->duty_ns = 0;
+}
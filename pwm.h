@@ -0,0 +1,41 @@
+/*
+ * Hardware PWM channels through the kernel pwm sysfs interface
+ *
+ * A head wired to a PWM-capable pin (GPIO 12, 13, 18 or 19 on the Pi 5,
+ * muxed with dtoverlay=pwm-2chan) can be dimmed or flashed by the PWM
+ * block itself. The control loop only writes a new period and duty when
+ * the head's state changes; flashing costs no CPU at all.
+ *
+ * Each channel's sysfs files are opened once, so a change is a single
+ * write() per attribute, skipped when the value is already set.
+ */
+
+#ifndef PWM_H
+#define PWM_H
+
+#include <stdint.h>
+
+#define PWM_DIM_PERIOD_NS   1000000ULL          // 1 kHz: steady to the eye
+#define PWM_FLASH_PERIOD_NS 1000000000ULL       // Flash once a second
+
+struct pwm_channel {
+    unsigned int chip;          // /sys/class/pwm/pwmchip<chip>
+    unsigned int channel;       // .../pwm<channel>
+    int period_fd, duty_fd, enable_fd;
+    uint64_t period_ns, duty_ns;
+};
+
+// Don't touch sysfs: channels only remember their settings (sim backend)
+void pwm_simulate(void);
+
+// Export the channel if needed and open its attributes
+// Returns 0 on success, -1 after printing an error.
+int pwm_open(struct pwm_channel *pwm, unsigned int chip, unsigned int channel);
+
+// Program period and high time, enabling the output. duty_ns = 0 is off.
+int pwm_set(struct pwm_channel *pwm, uint64_t period_ns, uint64_t duty_ns);
+
+// Disable the output and close its attributes
+void pwm_close(struct pwm_channel *pwm);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Real-time execution for the control loop
+ *
+ * Moves the calling thread to SCHED_FIFO, locks all current and future
+ * memory so page faults and writeback can't stall it, pins it to one
+ * CPU and prefaults its stack, so phase-change latency is bounded by the
+ * kernel rather than by whatever else runs on the box.
+ */
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#define RT_DEFAULT_PRIORITY     80
+
+// A CPU listed in /sys/devices/system/cpu/isolated, or else the last
+// online CPU
+int realtime_pick_cpu(void);
+
+// Enter real-time mode at a SCHED_FIFO priority, pinned to cpu (or
+// unpinned if cpu < 0). Returns 0 on success, -1 after printing an error.
+int realtime_enter(int priority, int cpu);
+
+#endif
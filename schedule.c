@@ -0,0 +1,247 @@
+/*
+ * Time-of-day and day-of-week plan calendar
+ * See schedule.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "schedule.h"
+
+#define NSEC_PER_SEC    1000000000LL
+
+static const char *const day_names[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+static int find_day(const char *name) {
+    for (int day = 0; day < 7; day++) {
+        if (strcmp(name, day_names[day]) == 0) return day;
+    }
+    return -1;
+}
+
+// Parse a day list such as "mon-fri,sun" into day bits, 0 on error
+static uint8_t parse_days(char *list) {
+    char *save, *tok;
+    uint8_t days = 0;
+    
+    for (tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *dash = strchr(tok, '-');
+        int first, last;
+    
+        if (strcmp(tok, "daily") == 0) {
+            days |= 0x7f;
+            continue;
+        }
+        if (strcmp(tok, "hol") == 0) {
+            days |= SCHEDULE_HOLIDAY;
+            continue;
+        }
+        if (dash) *dash = '\0';
+        first = find_day(tok);
+        last = dash ? find_day(dash + 1) : first;
+        if (first < 0 || last < 0) return 0;
+    
+        // Ranges may wrap round the weekend
+        for (int day = first;; day = (day + 1) % 7) {
+            days |= 1u << day;
+            if (day == last) break;
+        }
+    }
+    return days;
+}
+
+// Parse "HH:MM" into a minute of the day
+static int parse_minute(const char *tok) {
+    int hour, minute;
+    char end;
+    
+    if (sscanf(tok, "%d:%d%c", &hour, &minute, &end) != 2) return -1;
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59) return -1;
+    return hour * 60 + minute;
+}
+
+// Plan names are shared by every rule that uses them
+static int intern_plan(struct schedule *sched, const char *name) {
+    if (strcmp(name, "flash") == 0) return SCHEDULE_FLASH;
+    if (strlen(name) >= PLAN_NAME_LEN) return SCHEDULE_NONE;
+    for (int i = 0; i < sched->num_plans; i++) {
+        if (strcmp(name, sched->plans[i]) == 0) return i;
+    }
+    if (sched->num_plans == MAX_SCHEDULE_PLANS) return SCHEDULE_NONE;
+    snprintf(sched->plans[sched->num_plans], PLAN_NAME_LEN, "%s", name);
+    return sched->num_plans++;
+}
+
+// "schedule <days> <HH:MM> <plan>"
+static int parse_rule(struct schedule *sched, char *args) {
+    char *save, *days, *at, *plan;
+    struct schedule_rule *rule = &sched->rules[sched->num_rules];
+    int minute, index;
+    
+    days = strtok_r(args, " \t", &save);
+    at = strtok_r(NULL, " \t", &save);
+    plan = strtok_r(NULL, " \t", &save);
+    if (!plan || strtok_r(NULL, " \t", &save) || sched->num_rules == MAX_SCHEDULE_RULES) return -1;
+    
+    rule->days = parse_days(days);
+    minute = parse_minute(at);
+    index = intern_plan(sched, plan);
+    if (!rule->days || minute < 0 || index == SCHEDULE_NONE) return -1;
+    
+    rule->minute = minute;
+    rule->plan = index;
+    sched->num_rules++;
+    return 0;
+}
+
+// "holiday YYYY-MM-DD"
+static int parse_holiday(struct schedule *sched, const char *args) {
+    int year, month, day;
+    char end;
+    
+    if (sscanf(args, "%d-%d-%d %c", &year, &month, &day, &end) != 3) return -1;
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31) return -1;
+    if (sched->num_holidays == MAX_HOLIDAYS) return -1;
+    sched->holidays[sched->num_holidays++] = year * 10000 + month * 100 + day;
+    return 0;
+}
+
+int schedule_load(const char *path, struct schedule *sched) {
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    int line_no = 0;
+    
+    memset(sched, 0, sizeof(*sched));
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    
+    // Everything but the calendar is left to intersections_load()
+    while (fgets(line, sizeof(line), fp)) {
+        char *save, *key, *args;
+    
+        line_no++;
+        line[strcspn(line, "#\n")] = '\0';
+        key = strtok_r(line, " \t", &save);
+        if (!key) continue;
+        args = strtok_r(NULL, "", &save);
+        if (!args) args = "";
+    
+        if (strcmp(key, "schedule") == 0) {
+            if (parse_rule(sched, args) != 0) {
+                fprintf(stderr, "%s:%d: bad schedule, expected <days> <HH:MM> <plan|flash>, "
+                        "at most %d rules and %d plans\n", path, line_no, MAX_SCHEDULE_RULES, MAX_SCHEDULE_PLANS);
+                fclose(fp);
+                return -1;
+            }
+        } else if (strcmp(key, "holiday") == 0) {
+            if (parse_holiday(sched, args) != 0) {
+                fprintf(stderr, "%s:%d: expected a date (YYYY-MM-DD), at most %d holidays\n",
+                        path, line_no, MAX_HOLIDAYS);
+                fclose(fp);
+                return -1;
+            }
+        }
+    }
+    fclose(fp);
+    return sched->num_rules;
+}
+
+int schedule_bind(struct schedule *sched, const struct intersection *isects, int count) {
+    for (int plan = 0; plan < sched->num_plans; plan++) {
+        int found = 0;
+    
+        for (int i = 0; i < count; i++) {
+            int index = intersection_find_plan(&isects[i], sched->plans[plan]);
+    
+            sched->plan_index[plan][i] = index < 0 ? 0 : index;
+            found |= index >= 0;
+        }
+        if (!found) {
+            fprintf(stderr, "Schedule plan %s is not a plan of any intersection\n", sched->plans[plan]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int is_holiday(const struct schedule *sched, const struct tm *tm) {
+    int32_t date = (tm->tm_year + 1900) * 10000 + (tm->tm_mon + 1) * 100 + tm->tm_mday;
+    
+    for (int i = 0; i < sched->num_holidays; i++) {
+        if (sched->holidays[i] == date) return 1;
+    }
+    return 0;
+}
+
+// Local midnight of a day, days after the day of base, with its weekday and date
+static time_t local_day(const struct tm *base, int days, struct tm *day) {
+    *day = *base;
+    day->tm_mday += days;
+    day->tm_hour = day->tm_min = day->tm_sec = 0;
+    day->tm_isdst = -1;
+    return mktime(day);
+}
+
+static int compare_changes(const void *a, const void *b) {
+    const struct schedule_change *x = a, *y = b;
+    
+    if (x->real_ns != y->real_ns) return x->real_ns < y->real_ns ? -1 : 1;
+    return x->rule - y->rule;
+}
+
+int schedule_compile(struct schedule *sched, int64_t real_ns) {
+    time_t now = (time_t)(real_ns / NSEC_PER_SEC);
+    struct tm base, day;
+    int count = 0, plan = SCHEDULE_NONE;
+    
+    localtime_r(&now, &base);
+    for (int d = -SCHEDULE_BACK_DAYS; d <= SCHEDULE_AHEAD_DAYS; d++) {
+        uint8_t bit;
+    
+        local_day(&base, d, &day);
+        bit = is_holiday(sched, &day) ? SCHEDULE_HOLIDAY : 1u << day.tm_wday;
+        for (int r = 0; r < sched->num_rules; r++) {
+            struct tm at = day;
+    
+            if (!(sched->rules[r].days & bit)) continue;
+    
+            // mktime() copes with DST: a time skipped in spring runs late
+            at.tm_min = sched->rules[r].minute;
+            at.tm_isdst = -1;
+            sched->changes[count].real_ns = (int64_t)mktime(&at) * NSEC_PER_SEC;
+            sched->changes[count].plan = sched->rules[r].plan;
+            sched->changes[count++].rule = r;
+        }
+    }
+    sched->end_ns = (int64_t)local_day(&base, SCHEDULE_AHEAD_DAYS + 1, &day) * NSEC_PER_SEC;
+    qsort(sched->changes, count, sizeof(sched->changes[0]), compare_changes);
+    
+    // Keep the last rule of each instant
+    sched->num_changes = 0;
+    for (int i = 0; i < count; i++) {
+        if (i + 1 < count && sched->changes[i + 1].real_ns == sched->changes[i].real_ns) continue;
+        sched->changes[sched->num_changes++] = sched->changes[i];
+    }
+    
+    sched->next = 0;
+    while (sched->next < sched->num_changes && sched->changes[sched->next].real_ns <= real_ns) {
+        plan = sched->changes[sched->next++].plan;
+    }
+    return plan;
+}
+
+int64_t schedule_next_ns(const struct schedule *sched) {
+    if (sched->next < sched->num_changes) return sched->changes[sched->next].real_ns;
+    return sched->end_ns;
+}
+
+int schedule_fire(struct schedule *sched) {
+    if (sched->next < sched->num_changes) return sched->changes[sched->next++].plan;
+    
+    // Every change before end_ns has been taken; one at end_ns has not
+    (void)schedule_compile(sched, sched->end_ns - 1);
+    return SCHEDULE_NONE;
+}
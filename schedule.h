@@ -0,0 +1,91 @@
+/*
+ * Time-of-day and day-of-week plan calendar
+ *
+ * Calendar lines can go anywhere in the config file:
+ *
+ *   schedule mon-fri 07:00 am_peak      # weekdays from 07:00
+ *   schedule mon-fri 09:30 default
+ *   schedule daily 23:00 flash          # flash mode overnight
+ *   schedule daily 05:30 default
+ *   schedule hol 00:00 weekend          # on holidays, instead of the day's rules
+ *   holiday 2026-12-25
+ *
+ * Days are mon..sun, ranges such as mon-fri or fri-mon, daily, or hol,
+ * joined with commas. Each change switches every intersection that has a
+ * plan of that name (the others run "default") at its next cycle; "flash"
+ * puts the whole controller in flash mode until the next change.
+ *
+ * The rules are compiled into a sorted array of plan-change instants, in
+ * local time across a window of days, so the controller only ever keeps
+ * the next change armed and moving to it is O(1). The window is compiled
+ * again when it runs out.
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+#include "intersection.h"
+
+#define MAX_SCHEDULE_RULES      64
+#define MAX_HOLIDAYS            64
+#define MAX_SCHEDULE_PLANS      16      // Distinct plan names in the calendar
+#define SCHEDULE_BACK_DAYS      7       // Compiled before now, to find the plan in effect
+#define SCHEDULE_AHEAD_DAYS     14      // Compiled after now, before compiling again
+#define MAX_SCHEDULE_CHANGES    (MAX_SCHEDULE_RULES * (SCHEDULE_BACK_DAYS + SCHEDULE_AHEAD_DAYS + 1))
+
+#define SCHEDULE_HOLIDAY        0x80    // Day bit of "hol"; bits 0-6 are Sunday to Saturday
+
+#define SCHEDULE_FLASH          (-1)    // Plan of a change to flash mode
+#define SCHEDULE_NONE           (-2)    // No change
+
+struct schedule_rule {
+    uint8_t days;                       // Day bits
+    int16_t minute;                     // Minute of the day it applies from
+    int8_t plan;                        // Index in plans[], or SCHEDULE_FLASH
+};
+
+// One compiled plan change
+struct schedule_change {
+    int64_t real_ns;                    // CLOCK_REALTIME
+    int plan;
+    int rule;                           // Later rules win at the same instant
+};
+
+struct schedule {
+    int num_rules;
+    struct schedule_rule rules[MAX_SCHEDULE_RULES];
+    int num_holidays;
+    int32_t holidays[MAX_HOLIDAYS];     // YYYYMMDD
+    int num_plans;
+    char plans[MAX_SCHEDULE_PLANS][PLAN_NAME_LEN];
+    int8_t plan_index[MAX_SCHEDULE_PLANS][MAX_INTERSECTIONS];  // From schedule_bind()
+    
+    // The compiled window
+    int num_changes;
+    int next;                           // The armed change
+    int64_t end_ns;                     // Every change before this is in changes[]
+    struct schedule_change changes[MAX_SCHEDULE_CHANGES];
+};
+
+// Read the calendar lines of a config file
+// Returns the number of rules (0 if there are none), or -1 after printing
+// an error.
+int schedule_load(const char *path, struct schedule *sched);
+
+// Look up every calendar plan in each intersection
+// Returns 0, or -1 after printing an error if no intersection has one.
+int schedule_bind(struct schedule *sched, const struct intersection *isects, int count);
+
+// Compile the window around the wall-clock time real_ns and arm the first
+// change after it. Returns the plan in effect at real_ns, or SCHEDULE_NONE.
+int schedule_compile(struct schedule *sched, int64_t real_ns);
+
+// Wall-clock time at which schedule_fire() is next due
+int64_t schedule_next_ns(const struct schedule *sched);
+
+// Take the change due at schedule_next_ns() and arm the one after it.
+// Returns its plan, or SCHEDULE_NONE if only the window ran out.
+int schedule_fire(struct schedule *sched);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Asynchronous status logger
+ * See status_log.h
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include "intersection.h"
+#include "status_log.h"
+
+#define RING_MASK       (STATUS_LOG_SIZE - 1)
+#define DRAIN_NS        10000000L   // Formatter wakes every 10 ms
+
+// Same single-producer/single-consumer layout as the detector ring
+static struct {
+    _Alignas(64) atomic_uint head;      // Next slot the control loop fills
+    _Alignas(64) atomic_uint tail;      // Next slot the formatter reads
+    struct status_record records[STATUS_LOG_SIZE];
+} ring;
+
+static atomic_ullong dropped;
+static atomic_int running;
+static pthread_t thread;
+
+static FILE *out;
+static int num_isects;
+static status_print_fn print_fn;
+static void *print_arg;
+static struct status_record latest[MAX_INTERSECTIONS];
+
+void status_log(const struct status_record *rec) {
+    unsigned int head, tail;
+    
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) return;
+    
+    head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    if (head - tail == STATUS_LOG_SIZE) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring.records[head & RING_MASK] = *rec;
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+}
+
+// Format every queued record. Runs on the formatter thread only.
+static void drain(void) {
+    unsigned int tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring.head, memory_order_acquire);
+    
+    if (tail == head) return;
+    for (; tail != head; tail++) {
+        struct status_record rec = ring.records[tail & RING_MASK];
+        
+        // Hand the slot back before the (possibly slow) write
+        atomic_store_explicit(&ring.tail, tail + 1, memory_order_release);
+        
+        if (rec.isect < num_isects) {
+            latest[rec.isect] = rec;
+            print_fn(out, latest, num_isects, &latest[rec.isect], print_arg);
+        }
+    }
+    fflush(out);
+}
+
+static void *formatter_thread(void *arg) {
+    const struct timespec period = { .tv_sec = 0, .tv_nsec = DRAIN_NS };
+    
+    // On Linux this lowers the priority of this thread only
+    setpriority(PRIO_PROCESS, 0, STATUS_LOG_NICE);
+    
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        drain();
+        nanosleep(&period, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+int status_log_start(FILE *fp, int count, status_print_fn print, void *arg) {
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_t attr;
+    int err;
+    
+    out = fp;
+    num_isects = count < MAX_INTERSECTIONS ? count : MAX_INTERSECTIONS;
+    print_fn = print;
+    print_arg = arg;
+    memset(latest, 0, sizeof(latest));
+    
+    // Never inherit SCHED_FIFO from a real-time caller
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    
+    atomic_store(&running, 1);
+    err = pthread_create(&thread, &attr, formatter_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start status logger: %s\n", strerror(err));
+        atomic_store(&running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void status_log_stop(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&running, 0);
+    pthread_join(thread, NULL);
+}
+
+uint64_t status_log_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
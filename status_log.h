@@ -0,0 +1,54 @@
+/*
+ * Asynchronous status logger
+ *
+ * The control loop must never wait on stdout: a slow SSH session or a pipe
+ * into journald can block printf() for as long as it likes. Instead the
+ * loop copies a fixed-size binary record into a preallocated ring, and a
+ * low-priority thread formats the records and writes them. When the ring
+ * is full the record is dropped and counted, so the lights never wait for
+ * the log.
+ */
+
+#ifndef STATUS_LOG_H
+#define STATUS_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "phase_table.h"
+
+#define STATUS_LOG_SIZE     256     // Records; must be a power of two
+#define STATUS_LOG_NICE     10      // Nice value of the formatter thread
+
+#define STATUS_PED_CALL     0x01    // A pedestrian call is waiting
+#define STATUS_FLASH        0x02    // In flash mode; heads and phase unused
+
+// One phase change, or a change of flags, of one intersection
+struct status_record {
+    uint64_t time_ns;
+    head_mask_t heads;
+    uint32_t cycle;
+    uint8_t isect;
+    uint8_t phase;
+    uint8_t flags;
+};
+
+// Formats the status of every intersection. The logger keeps the latest
+// record of each; latest[rec->isect] is the one that just arrived.
+typedef void (*status_print_fn)(FILE *fp, const struct status_record *latest, int count,
+                                const struct status_record *rec, void *arg);
+
+// Start the formatter thread for count intersections. arg is passed to
+// print. Start it before realtime_enter() so it keeps normal scheduling
+// and every CPU. Returns 0 on success, -1 after printing an error.
+int status_log_start(FILE *fp, int count, status_print_fn print, void *arg);
+
+// Queue a record; never blocks. Does nothing unless the logger is running.
+void status_log(const struct status_record *rec);
+
+// Write whatever is still queued and stop the thread
+void status_log_stop(void);
+
+// Records lost because the ring was full
+uint64_t status_log_dropped(void);
+
+#endif
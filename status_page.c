@@ -0,0 +1,145 @@
+/*
+ * Shared-memory status page for local consumers
+ * See status_page.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "status_page.h"
+#include "status_log.h"
+#include "telemetry.h"
+
+static struct status_page *page;
+static char page_name[64];
+
+int status_page_open(const char *name, const struct intersection *isects, int count) {
+    void *m;
+    int fd;
+    
+    // Readers need no privileges, but only the controller writes
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(name);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(*page)) != 0) {
+        perror(name);
+        close(fd);
+        return -1;
+    }
+    m = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        perror("Cannot map status page");
+        return -1;
+    }
+    page = m;
+    snprintf(page_name, sizeof(page_name), "%s", name);
+    
+    // Readers of a stale page see the magic go away first
+    memset(page->magic, 0, sizeof(page->magic));
+    atomic_thread_fence(memory_order_release);
+    memset((char *)page + sizeof(page->magic), 0, sizeof(*page) - sizeof(page->magic));
+    page->version = STATUS_PAGE_VERSION;
+    page->num_isects = count;
+    page->pid = getpid();
+    for (int i = 0; i < count; i++) {
+        snprintf(page->isects[i].name, sizeof(page->isects[i].name), "%s", isects[i].name);
+    }
+    atomic_thread_fence(memory_order_release);
+    memcpy(page->magic, STATUS_PAGE_MAGIC, sizeof(STATUS_PAGE_MAGIC));
+    return 0;
+}
+
+void status_page_publish(int index, const struct intersection *isect, int flashing, int64_t late_ns) {
+    struct status_page_slot *slot;
+    struct status_page_state *st;
+    unsigned int seq;
+    
+    if (!page) return;
+    slot = &page->isects[index];
+    st = &slot->state;
+    
+    seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    // A phase change is reported once per phase, however often it is published
+    if (st->phase_start_ns != isect->phase_start_ns && !flashing) {
+        if (late_ns > (int64_t)TELEMETRY_LATE_NS) st->late_count++;
+        if (late_ns > st->max_late_ns) st->max_late_ns = late_ns;
+    }
+    st->phase_start_ns = isect->phase_start_ns;
+    st->deadline_ns = isect->deadline_ns;
+    st->late_ns = late_ns;
+    st->outputs = flashing ? isect->flash_masks.set_mask : isect->table->masks[isect->phase].set_mask;
+    st->heads = isect->table->plan.phases[isect->phase].heads;
+    st->cycle = isect->cycle;
+    st->phase = isect->phase;
+    st->flags = (isect->ped_call ? STATUS_PED_CALL : 0) | (flashing ? STATUS_FLASH : 0) |
+                (late_ns > (int64_t)TELEMETRY_LATE_NS ? STATUS_LATE : 0) | (st->flags & STATUS_CONFLICT);
+    
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+void status_page_conflict(int index) {
+    struct status_page_slot *slot;
+    unsigned int seq;
+    
+    if (!page) return;
+    slot = &page->isects[index];
+    
+    seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->state.flags |= STATUS_CONFLICT;
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+void status_page_close(void) {
+    if (!page) return;
+    munmap(page, sizeof(*page));
+    page = NULL;
+    shm_unlink(page_name);
+}
+
+const struct status_page *status_page_attach(const char *name) {
+    const struct status_page *p;
+    void *m;
+    int fd;
+    
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(name);
+        return NULL;
+    }
+    m = mmap(NULL, sizeof(*p), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        perror("Cannot map status page");
+        return NULL;
+    }
+    p = m;
+    if (memcmp(p->magic, STATUS_PAGE_MAGIC, sizeof(STATUS_PAGE_MAGIC)) != 0 || p->version != STATUS_PAGE_VERSION) {
+        fprintf(stderr, "%s: not a stoplight status page (or a different version)\n", name);
+        munmap(m, sizeof(*p));
+        return NULL;
+    }
+    return p;
+}
+
+void status_page_read(const struct status_page *p, int index, struct status_page_state *state) {
+    const struct status_page_slot *slot = &p->isects[index];
+    unsigned int before, after;
+    
+    do {
+        before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        *state = slot->state;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
@@ -0,0 +1,87 @@
+/*
+ * Shared-memory status page for local consumers
+ *
+ * With --status-page the controller keeps the state of every intersection
+ * in a POSIX shared-memory object (/dev/shm/stoplight-status by default)
+ * that any process on the box can map read-only: a cabinet HMI, a front
+ * panel, a health exporter. Each intersection has its own seqlock slot,
+ * written by the control loop at every phase change, button press and
+ * mode change exactly like the telemetry snapshot (see telemetry.h): the
+ * loop bumps a sequence number and stores a few words, and never waits
+ * or makes a system call. Readers poll as fast as they like without a
+ * system call either and without the loop ever noticing them; a reader
+ * that raced with an update just copies the slot again.
+ *
+ * All times are CLOCK_MONOTONIC, so a reader on the same box compares
+ * them with its own clock_gettime(CLOCK_MONOTONIC).
+ */
+
+#ifndef STATUS_PAGE_H
+#define STATUS_PAGE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "gpio_mask.h"
+#include "intersection.h"
+
+#define STATUS_PAGE_NAME        "/stoplight-status"
+#define STATUS_PAGE_MAGIC       "STLPAGE"
+#define STATUS_PAGE_VERSION     1
+
+// flags, besides STATUS_PED_CALL and STATUS_FLASH (see status_log.h)
+#define STATUS_LATE             0x04    // The last phase change was later than TELEMETRY_LATE_NS
+#define STATUS_CONFLICT         0x08    // The conflict monitor tripped on this intersection
+
+// What a reader copies out of a slot
+struct status_page_state {
+    uint64_t phase_start_ns;
+    uint64_t deadline_ns;               // End of the current phase
+    int64_t late_ns;                    // How late the last phase change was written
+    int64_t max_late_ns;                // Latest phase change so far
+    uint64_t late_count;                // Phase changes later than TELEMETRY_LATE_NS
+    struct gpio_mask outputs;           // Pins the current phase drives high
+    head_mask_t heads;
+    uint32_t cycle;
+    uint8_t phase;
+    uint8_t flags;
+};
+
+// seq is odd while the control loop is writing state
+struct status_page_slot {
+    _Alignas(64) atomic_uint seq;
+    char name[32];                      // Written once, before the loop starts
+    struct status_page_state state;
+};
+
+struct status_page {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_isects;
+    int32_t pid;                        // The controller writing the page
+    struct status_page_slot isects[MAX_INTERSECTIONS];
+};
+
+// Create (or take over) the page at name and fill in count intersections.
+// Call before realtime_enter(), so the page is locked in with the rest.
+// Returns 0 on success, -1 after printing an error.
+int status_page_open(const char *name, const struct intersection *isects, int count);
+
+// Publish the current state of intersection index. Only the control loop
+// may call this; it does nothing unless the page is open.
+void status_page_publish(int index, const struct intersection *isect, int flashing, int64_t late_ns);
+
+// Mark intersection index as the one the conflict monitor tripped on; it
+// stays marked. Only the control loop may call this.
+void status_page_conflict(int index);
+
+// Remove the page
+void status_page_close(void);
+
+// For readers: map the page at name read-only. Returns NULL after
+// printing an error.
+const struct status_page *status_page_attach(const char *name);
+
+// For readers: a consistent copy of the state of intersection index
+void status_page_read(const struct status_page *page, int index, struct status_page_state *state);
+
+#endif
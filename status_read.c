@@ -0,0 +1,82 @@
+/*
+ * Status page reader
+ * Prints the state stoplight --status-page publishes in shared memory
+ *
+ * Compile: see CMakeLists.txt (target "stoplight_status")
+ * Run: ./stoplight_status [-w MS] [page-name]
+ *
+ * One line per intersection: phase, cycle, lit heads, pins driven high
+ * (bank 0), time left in the phase, how late the last phase change was,
+ * the latest one so far and how many were late, and the flags. With -w
+ * the lines are printed again every MS milliseconds. Reading the page
+ * takes no system call and never holds up the controller.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "status_log.h"
+#include "status_page.h"
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void print_page(const struct status_page *page) {
+    uint64_t now = now_ns();
+    
+    for (uint32_t i = 0; i < page->num_isects; i++) {
+        struct status_page_state st;
+    
+        status_page_read(page, i, &st);
+        printf("%-16s phase=%u cycle=%u heads=0x%02x outputs=0x%08x remaining_ms=%llu "
+               "late_us=%lld max_late_us=%lld late_count=%llu%s%s%s%s\n",
+               page->isects[i].name, st.phase, st.cycle, (unsigned int)st.heads, st.outputs.bank[0],
+               (st.flags & STATUS_FLASH) || st.deadline_ns < now ?
+                   0ULL : (unsigned long long)((st.deadline_ns - now) / 1000000),
+               (long long)(st.late_ns / 1000), (long long)(st.max_late_ns / 1000),
+               (unsigned long long)st.late_count,
+               st.flags & STATUS_FLASH ? " flash" : "", st.flags & STATUS_PED_CALL ? " call" : "",
+               st.flags & STATUS_LATE ? " late" : "", st.flags & STATUS_CONFLICT ? " conflict" : "");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const struct status_page *page;
+    const char *name = STATUS_PAGE_NAME;
+    long interval_ms = 0;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "w:h")) != -1) {
+        switch (opt) {
+        case 'w':
+            interval_ms = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-w MS] [page-name]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc) name = argv[optind];
+    
+    page = status_page_attach(name);
+    if (!page) return 1;
+    if (kill(page->pid, 0) != 0 && errno == ESRCH) fprintf(stderr, "Warning: controller %d is not running\n", page->pid);
+    
+    print_page(page);
+    while (interval_ms > 0) {
+        struct timespec delay = { interval_ms / 1000, interval_ms % 1000 * 1000000L };
+    
+        nanosleep(&delay, NULL);
+        printf("\n");
+        print_page(page);
+        fflush(stdout);
+    }
+    return 0;
+}
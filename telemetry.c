@@ -0,0 +1,187 @@
+/*
+ * State snapshot and UDP telemetry/control endpoint
+ * See telemetry.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "telemetry.h"
+#include "controller.h"
+#include "event_loop.h"
+#include "monitor.h"
+#include "phase_timer.h"
+#include "status_log.h"
+
+#define EVENT_REQUEST   EVENT_USER      // The socket has a datagram
+#define REPLY_LINE      160     // Longest status line
+
+// seq is odd while the control loop is writing state. A reader that sees
+// an odd or changed seq around its copy has a torn copy and tries again.
+static struct {
+    _Alignas(64) atomic_uint seq;
+    struct telemetry_state state;
+} slots[MAX_INTERSECTIONS];
+
+static const struct intersection *isects;
+static int num_isects;
+
+static atomic_int running;
+static pthread_t thread;
+static struct event_loop loop = EVENT_LOOP_CLOSED;
+static int sock = -1;
+
+// Preallocated so a request never allocates
+static char request[64];
+static char reply[MAX_INTERSECTIONS * REPLY_LINE];
+
+void telemetry_publish(int index, const struct intersection *isect, int flashing, int64_t late_ns) {
+    unsigned int seq;
+    
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) return;
+    
+    seq = atomic_load_explicit(&slots[index].seq, memory_order_relaxed);
+    atomic_store_explicit(&slots[index].seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    slots[index].state.phase_start_ns = isect->phase_start_ns;
+    slots[index].state.deadline_ns = isect->deadline_ns;
+    slots[index].state.late_ns = late_ns;
+    slots[index].state.heads = isect->table->plan.phases[isect->phase].heads;
+    slots[index].state.cycle = isect->cycle;
+    slots[index].state.phase = isect->phase;
+    slots[index].state.flags = (isect->ped_call ? STATUS_PED_CALL : 0) | (flashing ? STATUS_FLASH : 0);
+    
+    atomic_store_explicit(&slots[index].seq, seq + 2, memory_order_release);
+}
+
+void telemetry_read(int index, struct telemetry_state *state) {
+    unsigned int before, after;
+    
+    do {
+        before = atomic_load_explicit(&slots[index].seq, memory_order_acquire);
+        *state = slots[index].state;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slots[index].seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+// Format the status of every intersection into reply. Returns its length.
+static size_t format_status(void) {
+    uint64_t now = clock_now_ns();
+    size_t len = 0;
+    
+    for (int i = 0; i < num_isects; i++) {
+        struct telemetry_state st;
+    
+        telemetry_read(i, &st);
+        len += snprintf(reply + len, sizeof reply - len,
+                        "%s phase=%u cycle=%u heads=0x%x remaining_ms=%llu late_us=%lld mode=%s call=%d fault=%s\n",
+                        isects[i].name, st.phase, st.cycle, (unsigned int)st.heads,
+                        (st.flags & STATUS_FLASH) || st.deadline_ns < now ?
+                            0ULL : (unsigned long long)((st.deadline_ns - now) / 1000000),
+                        (long long)(st.late_ns / 1000), st.flags & STATUS_FLASH ? "flash" : "plan",
+                        (st.flags & STATUS_PED_CALL) != 0,
+                        monitor_tripped() ? "conflict" : st.late_ns > (int64_t)TELEMETRY_LATE_NS ? "late" : "none");
+        if (len >= sizeof reply) return sizeof reply - 1;
+    }
+    return len;
+}
+
+// Answer one request into reply. Returns its length.
+static size_t handle(size_t len) {
+    // Commands may come from nc or echo with a newline
+    while (len && (request[len - 1] == '\n' || request[len - 1] == '\r' || request[len - 1] == ' ')) len--;
+    request[len] = '\0';
+    
+    if (strcmp(request, "status") == 0) return format_status();
+    if (strcmp(request, "flash") == 0 || strcmp(request, "plan") == 0) {
+        controller_request_flash(request[0] == 'f');
+        return snprintf(reply, sizeof reply, "ok %s\n", request);
+    }
+    return snprintf(reply, sizeof reply, "error unknown command\n");
+}
+
+// Sleeps until a request arrives or telemetry_stop() wakes it
+static void *server_thread(void *arg) {
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        struct sockaddr_storage from;
+        socklen_t from_len = sizeof from;
+        ssize_t len;
+    
+        if (!(event_loop_wait(&loop, EVENT_NEVER) & EVENT_BIT(EVENT_REQUEST))) continue;
+    
+        len = recvfrom(sock, request, sizeof request - 1, MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+        if (len < 0) continue;
+    
+        size_t out = handle((size_t)len);
+        (void)sendto(sock, reply, out, 0, (struct sockaddr *)&from, from_len);
+    }
+    return NULL;
+}
+
+int telemetry_start(uint16_t port, const struct intersection *list, int count) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_t attr;
+    int err;
+    
+    isects = list;
+    num_isects = count;
+    
+    sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("telemetry socket");
+        return -1;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        fprintf(stderr, "Failed to bind telemetry port %u: %s\n", port, strerror(errno));
+        close(sock);
+        sock = -1;
+        return -1;
+    }
+    if (event_loop_open(&loop, NULL) != 0 || event_loop_add(&loop, sock, EVENT_REQUEST) != 0) {
+        event_loop_close(&loop);
+        close(sock);
+        sock = -1;
+        return -1;
+    }
+    
+    // Never inherit a real-time policy: answering the monitor can wait
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    
+    atomic_store(&running, 1);
+    err = pthread_create(&thread, &attr, server_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start telemetry thread: %s\n", strerror(err));
+        atomic_store(&running, 0);
+        event_loop_close(&loop);
+        close(sock);
+        sock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void telemetry_stop(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&running, 0);
+    event_loop_wake(&loop);
+    pthread_join(thread, NULL);
+    event_loop_close(&loop);
+    close(sock);
+    sock = -1;
+}
@@ -0,0 +1,59 @@
+/*
+ * State snapshot and UDP telemetry/control endpoint
+ *
+ * The control loop publishes the state of an intersection into a
+ * per-intersection seqlock after every change: the loop only ever writes
+ * a sequence number and a few words, and never waits. A server thread
+ * answers queries from a central monitor out of those snapshots, retrying
+ * a read that raced with the loop, so the phase loop never contends on a
+ * lock and a request allocates nothing.
+ *
+ * The protocol is one text command per datagram, with a text reply:
+ *
+ *       status      one line per intersection:
+ *                   <name> phase=N cycle=N heads=0xM remaining_ms=N
+ *                   late_us=N mode=plan|flash call=0|1 fault=none|late|conflict
+ *       flash       switch to flash mode
+ *       plan        leave flash mode, restarting the plans
+ *
+ * The server thread sleeps in its own event loop until a datagram
+ * arrives. Mode commands take effect at once: the server hands them to
+ * the control loop with controller_request_flash(), which wakes it. There
+ * is no authentication; keep the port on a management network.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "intersection.h"
+
+#define TELEMETRY_LATE_NS       10000000ULL     // Phase changes later than 10 ms are a fault
+                                                // (a tripped conflict monitor is always one)
+
+// What the server knows about one intersection
+struct telemetry_state {
+    uint64_t phase_start_ns;
+    uint64_t deadline_ns;       // CLOCK_MONOTONIC end of the current phase
+    int64_t late_ns;            // How late the last phase change was written
+    head_mask_t heads;
+    uint32_t cycle;
+    uint8_t phase;
+    uint8_t flags;              // STATUS_PED_CALL, STATUS_FLASH
+};
+
+// Start the server thread on a UDP port for count intersections
+// Returns 0 on success, -1 after printing an error.
+int telemetry_start(uint16_t port, const struct intersection *isects, int count);
+
+// Stop the server thread
+void telemetry_stop(void);
+
+// Publish the current state of intersection index. Only the control loop
+// may call this; it does nothing unless the server is running.
+void telemetry_publish(int index, const struct intersection *isect, int flashing, int64_t late_ns);
+
+// Consistent copy of the latest state of intersection index
+void telemetry_read(int index, struct telemetry_state *state);
+
+#endif
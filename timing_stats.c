@@ -0,0 +1,112 @@
+/*
+ * Phase-transition timing instrumentation
+ * See timing_stats.h
+ */
+
+#include <signal.h>
+#include <stdatomic.h>
+#include "timing_stats.h"
+
+#define SUB_BITS        3                           // 8 buckets per octave
+#define LINEAR_LIMIT    (2 << SUB_BITS)             // Values below are exact
+#define NUM_BUCKETS     (LINEAR_LIMIT + (31 - SUB_BITS) * (1 << SUB_BITS))
+#define MAX_VALUE_NS    0xffffffffULL               // ~4.3 s, larger values clamp
+
+struct histogram {
+    atomic_uint count[NUM_BUCKETS];
+    atomic_ullong total;
+    atomic_ullong max;
+};
+
+static struct histogram phase_jitter[MAX_INTERSECTIONS][MAX_PHASES];
+static struct histogram write_time;
+static volatile sig_atomic_t dump_requested;
+
+static int bucket_of(uint64_t ns) {
+    int msb;
+    
+    if (ns > MAX_VALUE_NS) ns = MAX_VALUE_NS;
+    if (ns < LINEAR_LIMIT) return (int)ns;
+    
+    // Leading bit picks the octave, the next SUB_BITS bits the bucket in it
+    msb = 63 - __builtin_clzll(ns);
+    return LINEAR_LIMIT + ((msb - SUB_BITS - 1) << SUB_BITS)
+           + (int)((ns >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+}
+
+// Largest value that falls in a bucket
+static uint64_t bucket_limit(int bucket) {
+    int octave, sub;
+    
+    if (bucket < LINEAR_LIMIT) return bucket;
+    octave = (bucket - LINEAR_LIMIT) >> SUB_BITS;
+    sub = (bucket - LINEAR_LIMIT) & ((1 << SUB_BITS) - 1);
+    return ((uint64_t)((1 << SUB_BITS) + sub + 1) << (octave + 1)) - 1;
+}
+
+static void record(struct histogram *h, uint64_t ns) {
+    atomic_fetch_add_explicit(&h->count[bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+    
+    // Only the control loop records, so a plain compare then store is enough
+    if (ns > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, ns, memory_order_relaxed);
+    }
+}
+
+void timing_record_phase(int isect, int phase, uint64_t scheduled_ns, uint64_t actual_ns) {
+    // Writes coalesced slightly ahead of their deadline count as on time
+    record(&phase_jitter[isect][phase], actual_ns > scheduled_ns ? actual_ns - scheduled_ns : 0);
+}
+
+void timing_record_write(uint64_t write_ns) {
+    record(&write_time, write_ns);
+}
+
+static uint64_t percentile(const struct histogram *h, uint64_t total, int pct) {
+    uint64_t target = (total * pct + 99) / 100, seen = 0;
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        seen += atomic_load_explicit(&h->count[b], memory_order_relaxed);
+        if (seen >= target) return bucket_limit(b) < max ? bucket_limit(b) : max;
+    }
+    return max;
+}
+
+static void print_row(FILE *fp, const char *label, const char *phase, const struct histogram *h) {
+    uint64_t total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    
+    if (total == 0) return;
+    fprintf(fp, "  %-16s %5s %10llu %10.1f %10.1f %10.1f\n", label, phase,
+            (unsigned long long)total,
+            percentile(h, total, 50) / 1000.0, percentile(h, total, 99) / 1000.0,
+            atomic_load_explicit(&h->max, memory_order_relaxed) / 1000.0);
+}
+
+void timing_stats_dump(FILE *fp, const struct intersection *isects, int count) {
+    fprintf(fp, "\nPhase change lateness (us):\n");
+    fprintf(fp, "  %-16s %5s %10s %10s %10s %10s\n", "Intersection", "Phase", "Count", "p50", "p99", "max");
+    for (int i = 0; i < count && i < MAX_INTERSECTIONS; i++) {
+        for (int p = 0; p < isects[i].table->plan.num_phases; p++) {
+            char phase[12];
+            
+            snprintf(phase, sizeof(phase), "%d", p);
+            print_row(fp, isects[i].name, phase, &phase_jitter[i][p]);
+        }
+    }
+    
+    fprintf(fp, "Output write duration (us):\n");
+    print_row(fp, "all writes", "-", &write_time);
+    fflush(fp);
+}
+
+void timing_stats_request_dump(void) {
+    dump_requested = 1;
+}
+
+void timing_stats_poll(FILE *fp, const struct intersection *isects, int count) {
+    if (!dump_requested) return;
+    dump_requested = 0;
+    timing_stats_dump(fp, isects, count);
+}
@@ -0,0 +1,37 @@
+/*
+ * Phase-transition timing instrumentation
+ *
+ * The control loop records, for every phase change, how late the write
+ * happened relative to the scheduled deadline, and how long the write
+ * itself took. Samples go into fixed-size log-linear histograms (8 buckets
+ * per power of two, so percentiles are within 12.5%) using relaxed atomic
+ * increments: recording never allocates, locks or prints.
+ *
+ * timing_stats_dump() prints p50/p99/max per intersection and phase. A
+ * signal handler may call timing_stats_request_dump(); the control loop
+ * then prints the report from timing_stats_poll() at its next wakeup.
+ */
+
+#ifndef TIMING_STATS_H
+#define TIMING_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "intersection.h"
+
+// Record one phase change of an intersection
+void timing_record_phase(int isect, int phase, uint64_t scheduled_ns, uint64_t actual_ns);
+
+// Record how long one output write took
+void timing_record_write(uint64_t write_ns);
+
+// Print the report for these intersections
+void timing_stats_dump(FILE *fp, const struct intersection *isects, int count);
+
+// Ask for a report (async-signal-safe)
+void timing_stats_request_dump(void);
+
+// Print the report if one was requested since the last call
+void timing_stats_poll(FILE *fp, const struct intersection *isects, int count);
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * AArch64 assembly phase stepping and generic-timer waits
+ *
+ * traffic_light_asm.s is the phase table interpreter of the C controllers
+ * in a few dozen instructions, for deployments where even libc threads
+ * are too much: bare metal, or a static binary in an initramfs. It lights
+ * a phase with two register stores, and times phases against the ARM
+ * generic timer (CNTVCT_EL0, counting at CNTFRQ_EL0 - 54 MHz on a Pi 5)
+ * rather than a spin count, so a delay is the same at every CPU frequency.
+ * Between checks the core sleeps in WFE. Under Linux the timer event
+ * stream wakes it every 100 us; on bare metal, enable it (CNTKCTL_EL1.EVNTEN)
+ * or an interrupt must.
+ *
+ * The register pointers are whatever the GPIO block provides for "set
+ * these bits" and "clear these bits": GPSET0/GPCLR0 from the mmap backend,
+ * or the RP1 RIO set and clear aliases.
+ */
+
+#ifndef TRAFFIC_LIGHT_ASM_H
+#define TRAFFIC_LIGHT_ASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TL_DEFAULT_PHASES   6
+
+// One phase table entry; 16 bytes so the assembly indexes with a shift
+struct tl_phase {
+    uint32_t mask;              // Pins lit during the phase
+    uint32_t duration_us;
+    uint32_t next;              // Index of the following phase
+    uint32_t reserved;
+};
+
+// Everything the assembly loop reads and writes
+struct tl_ctx {
+    volatile uint32_t *set_reg;     // A mask stored here drives those pins high
+    volatile uint32_t *clear_reg;   // ... and here drives them low
+    const struct tl_phase *table;
+    uint32_t all_mask;              // Every pin the table drives
+    uint32_t phase;                 // Phase tl_step() lights next
+    uint32_t cycle;                 // Cycles started
+    uint32_t reserved;
+    uint64_t deadline;              // CNTVCT_EL0 count at which the lit phase ends
+};
+
+// The offsets are spelled out again in traffic_light_asm.s
+_Static_assert(sizeof(struct tl_phase) == 16, "tl_phase layout is shared with the assembly");
+_Static_assert(offsetof(struct tl_ctx, all_mask) == 24 && offsetof(struct tl_ctx, cycle) == 32 &&
+               offsetof(struct tl_ctx, deadline) == 40, "tl_ctx layout is shared with the assembly");
+
+// The standard cycle of default_plan, on the standard wiring
+extern const struct tl_phase tl_default_table[TL_DEFAULT_PHASES];
+
+// CNTVCT_EL0 now, and its rate in Hz
+uint64_t tl_counter(void);
+uint64_t tl_counter_hz(void);
+
+// Store set_mask to *set_reg, then clear_mask to *clear_reg
+void tl_apply(volatile uint32_t *set_reg, volatile uint32_t *clear_reg,
+              uint32_t set_mask, uint32_t clear_mask);
+
+// Sleep in WFE until CNTVCT_EL0 reaches count
+void tl_wait_until(uint64_t count);
+
+// Light ctx->phase, move ctx->deadline on by its duration and make its
+// next phase current. Returns the phase it lit.
+uint32_t tl_step(struct tl_ctx *ctx);
+
+// Step through the table from now until *keep_running is 0
+void tl_run(struct tl_ctx *ctx, volatile int *keep_running);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * ARM Assembly Traffic Light - phase stepping and generic-timer waits
+ * See traffic_light_asm.h
+ *
+ * This is the same state machine as the C controllers: a phase table with
+ * one row per phase, walked by tl_step(). It assembles into the
+ * traffic_light_bare program (see CMakeLists.txt) and every function
+ * follows the AAPCS64 calling convention, so C code can call it.
+ */
+
+// GPIO Pin definitions (as immediate values)
+.equ STREET_A_RED,    17
+.equ STREET_A_YELLOW, 27
+.equ STREET_A_GREEN,  22
+.equ STREET_B_RED,    23
+.equ STREET_B_YELLOW, 24
+.equ STREET_B_GREEN,  25
+
+// Phase table entry layout (struct tl_phase in traffic_light_asm.h)
+// Each entry is 16 bytes so the index can be scaled with a single shift.
+.equ PHASE_MASK,      0           // Pins lit during the phase
+.equ PHASE_DURATION,  4           // Duration in microseconds
+.equ PHASE_NEXT,      8           // Index of the following phase
+.equ PHASE_SHIFT,     4           // log2(entry size)
+
+// struct tl_ctx layout
+.equ CTX_SET_REG,     0           // Register that sets the pins in a mask
+.equ CTX_CLEAR_REG,   8           // Register that clears them
+.equ CTX_TABLE,       16
+.equ CTX_ALL_MASK,    24          // Every pin the table drives
+.equ CTX_PHASE,       28          // Phase to light next
+.equ CTX_CYCLE,       32          // Cycles started
+.equ CTX_DEADLINE,    40          // CNTVCT_EL0 count at which the phase ends
+
+// Timing (in microseconds - the generic timer makes them exact)
+.equ GREEN_TIME,      5000000
+.equ YELLOW_TIME,     1000000
+.equ SAFETY_BUFFER,   1000000
+
+// Bit masks for each LED (1 << pin_number)
+.equ MASK_A_RED,      (1 << STREET_A_RED)
+.equ MASK_A_YELLOW,   (1 << STREET_A_YELLOW)
+.equ MASK_A_GREEN,    (1 << STREET_A_GREEN)
+.equ MASK_B_RED,      (1 << STREET_B_RED)
+.equ MASK_B_YELLOW,   (1 << STREET_B_YELLOW)
+.equ MASK_B_GREEN,    (1 << STREET_B_GREEN)
+
+.section .rodata
+
+// The six-phase cycle from phase_table.c: mask, duration, next, padding
+// Adding a phase means adding a row here - the loop below doesn't change.
+.balign 16
+.global tl_default_table
+.type   tl_default_table, %object
+tl_default_table:
+    .word MASK_A_GREEN  | MASK_B_RED,    GREEN_TIME,    1, 0   // A Green, B Red
+    .word MASK_A_YELLOW | MASK_B_RED,    YELLOW_TIME,   2, 0   // A Yellow, B Red
+    .word MASK_A_RED    | MASK_B_RED,    SAFETY_BUFFER, 3, 0   // Both Red (buffer)
+    .word MASK_A_RED    | MASK_B_GREEN,  GREEN_TIME,    4, 0   // A Red, B Green
+    .word MASK_A_RED    | MASK_B_YELLOW, YELLOW_TIME,   5, 0   // A Red, B Yellow
+    .word MASK_A_RED    | MASK_B_RED,    SAFETY_BUFFER, 0, 0   // Both Red (buffer)
+.size   tl_default_table, . - tl_default_table
+
+.text
+
+// uint64_t tl_counter(void)
+// Read the virtual counter. The ISB stops it being read ahead of the
+// instructions before it.
+.global tl_counter
+.type   tl_counter, %function
+tl_counter:
+    isb
+    mrs     x0, cntvct_el0
+    ret
+.size   tl_counter, . - tl_counter
+
+// uint64_t tl_counter_hz(void)
+.global tl_counter_hz
+.type   tl_counter_hz, %function
+tl_counter_hz:
+    mrs     x0, cntfrq_el0
+    ret
+.size   tl_counter_hz, . - tl_counter_hz
+
+// void tl_apply(set_reg, clear_reg, set_mask, clear_mask)
+// New heads go on before old ones go off, so no phase change is dark
+.global tl_apply
+.type   tl_apply, %function
+tl_apply:
+    str     w2, [x0]                // Drive set_mask high
+    str     w3, [x1]                // Then clear_mask low
+    ret
+.size   tl_apply, . - tl_apply
+
+// void tl_wait_until(uint64_t count)
+// WFE sleeps until an event: the timer event stream or an interrupt
+.global tl_wait_until
+.type   tl_wait_until, %function
+tl_wait_until:
+1:
+    isb
+    mrs     x1, cntvct_el0
+    cmp     x1, x0
+    b.hs    2f                      // Unsigned >=: the deadline has passed
+    wfe
+    b       1b
+2:
+    ret
+.size   tl_wait_until, . - tl_wait_until
+
+// uint32_t tl_step(struct tl_ctx *ctx)
+// Light ctx->phase, move the deadline on and follow the table
+.global tl_step
+.type   tl_step, %function
+tl_step:
+    // Locate the table entry for the current phase
+    ldr     x1, [x0, #CTX_TABLE]
+    ldr     w2, [x0, #CTX_PHASE]            // w2 = phase index (upper half of x2 zeroed)
+    add     x3, x1, x2, lsl #PHASE_SHIFT    // x3 = &table[w2]
+    
+    // A new cycle starts every time phase 0 comes round
+    cbnz    w2, 1f
+    ldr     w4, [x0, #CTX_CYCLE]
+    add     w4, w4, #1
+    str     w4, [x0, #CTX_CYCLE]
+1:
+    // Light the heads for this phase: one store on, one store off
+    ldr     w4, [x3, #PHASE_MASK]           // w4 = pins to turn on
+    ldr     w5, [x0, #CTX_ALL_MASK]
+    bic     w5, w5, w4                      // w5 = every other driven pin
+    ldr     x6, [x0, #CTX_SET_REG]
+    ldr     x7, [x0, #CTX_CLEAR_REG]
+    str     w4, [x6]
+    str     w5, [x7]
+    
+    // deadline += duration_us * CNTFRQ / 1000000, kept absolute so
+    // phases never drift however late a wakeup was
+    ldr     w4, [x3, #PHASE_DURATION]
+    mrs     x5, cntfrq_el0
+    mul     x4, x4, x5
+    movz    x5, #0x4240                     // x5 = 1000000 (0xF4240)
+    movk    x5, #0xf, lsl #16
+    udiv    x4, x4, x5
+    ldr     x5, [x0, #CTX_DEADLINE]
+    add     x5, x5, x4
+    str     x5, [x0, #CTX_DEADLINE]
+    
+    // Advance to the next phase named by the table
+    ldr     w4, [x3, #PHASE_NEXT]
+    str     w4, [x0, #CTX_PHASE]
+    mov     w0, w2
+    ret
+.size   tl_step, . - tl_step
+
+// void tl_run(struct tl_ctx *ctx, volatile int *keep_running)
+// Step, then sleep to the deadline, checking keep_running at every
+// wakeup: a signal handler that clears it wakes WFE on its way back.
+.global tl_run
+.type   tl_run, %function
+tl_run:
+    stp     x29, x30, [sp, #-32]!   // Push frame pointer and link register
+    mov     x29, sp                 // Set up frame pointer
+    stp     x19, x20, [sp, #16]     // Callee-saved: ctx, keep_running
+    mov     x19, x0
+    mov     x20, x1
+    
+    // The first phase starts now
+    bl      tl_counter
+    str     x0, [x19, #CTX_DEADLINE]
+    
+.Lstep:
+    mov     x0, x19
+    bl      tl_step
+.Lwait:
+    ldr     w0, [x20]
+    cbz     w0, .Ldone
+    isb
+    mrs     x0, cntvct_el0
+    ldr     x1, [x19, #CTX_DEADLINE]
+    cmp     x0, x1
+    b.hs    .Lstep
+    wfe
+    b       .Lwait
+    
+.Ldone:
+    ldp     x19, x20, [sp, #16]
+    ldp     x29, x30, [sp], #32
+    ret
+.size   tl_run, . - tl_run
+
+// No executable stack
+.section .note.GNU-stack, "", %progbits
+
+
+/*
+ * KEY ARM ASSEMBLY INSTRUCTIONS DEMONSTRATED:
+ * 
+ * 1. STP/LDP - Store/Load Pair (push/pop registers)
+ *    stp x29, x30, [sp, #-16]!    // Push two registers, decrement stack pointer
+ * 
+ * 2. ADRP/ADD - Address calculation (position-independent code)
+ *    adrp x0, label               // Load page address of label
+ *    add x0, x0, :lo12:label      // Add low 12 bits offset
+ * 
+ * 3. LDR/STR - Load/Store Register
+ *    ldr w1, [x0]                 // Load 32-bit word from memory
+ *    str w1, [x0]                 // Store 32-bit word to memory
+ * 
+ * 4. CMP - Compare (sets flags)
+ *    cmp w1, #STATE_A_GREEN       // Compare w1 with immediate value
+ * 
+ * 5. B.EQ, B.NE - Conditional Branch
+ *    b.eq label                   // Branch if equal (Z flag set)
+ *    b.ne label                   // Branch if not equal (Z flag clear)
+ * 
+ * 6. BL - Branch with Link (function call)
+ *    bl function                  // Call function, save return address in x30
+ * 
+ * 7. RET - Return from function
+ *    ret                          // Return (jump to address in x30)
+ * 
+ * 8. SUBS - Subtract and Set flags
+ *    subs w0, w0, #1              // w0 = w0 - 1, update flags
+ * 
+ * 9. MOV - Move immediate
+ *    mov w1, #5                   // w1 = 5
+ * 
+ * 10. STR WZR - Store Zero Register
+ *     str wzr, [x0]               // Store 0 to memory (wzr always = 0)
+ * 
+ * 11. ADD with shifted register - Table indexing
+ *     add x2, x19, x1, lsl #4     // x2 = x19 + (x1 << 4)
+ * 
+ * 12. CBNZ/CBZ - Compare and Branch if (Not) Zero
+ *     cbnz w1, label              // Branch if w1 != 0 (no CMP needed)
+ * 
+ * 13. MRS - Read a system register
+ *     mrs x0, cntvct_el0          // Generic timer count
+ *     mrs x0, cntfrq_el0          // Its frequency in Hz
+ * 
+ * 14. ISB - Instruction Synchronization Barrier
+ *     isb                         // Don't read the counter early
+ * 
+ * 15. WFE - Wait For Event
+ *     wfe                         // Sleep the core until an event
+ * 
+ * 16. MOVZ/MOVK - Build a wide constant 16 bits at a time
+ *     movz x5, #0x4240            // x5 = 0x4240
+ *     movk x5, #0xf, lsl #16      // x5 = 0xF4240
+ * 
+ * 17. MUL/UDIV - Multiply and unsigned divide
+ *     udiv x4, x4, x5             // x4 = x4 / x5
+ * 
+ * 18. BIC - Bit Clear
+ *     bic w5, w5, w4              // w5 = w5 & ~w4
+ */
+
+/*
+ * COMPARISON TO MIPS:
+ * 
+ * ARM                          | MIPS Equivalent
+ * -----------------------------|----------------------------------
+ * ldr w1, [x0]                 | lw $t1, 0($t0)
+ * str w1, [x0]                 | sw $t1, 0($t0)
+ * mov w1, #5                   | li $t1, 5
+ * add w2, w1, w0              | add $t2, $t1, $t0
+ * subs w0, w0, #1             | addi $t0, $t0, -1
+ * b.eq label                   | beq $t0, $zero, label
+ * bl function                  | jal function
+ * ret                          | jr $ra
+ * 
+ * KEY DIFFERENCES:
+ * - ARM uses x0-x30 (64-bit) or w0-w30 (32-bit) registers
+ * - MIPS uses $t0-$t9, $s0-$s7, etc.
+ * - ARM can do immediate operands in more instructions
+ * - ARM has conditional execution on many instructions
+ * - MIPS has delay slots, ARM doesn't
+ * - ARM position-independent code uses ADRP/ADD
+ * - MIPS uses absolute or PC-relative addressing
+ */
@@ -1,323 +0,0 @@
-/*
- * ARM Assembly Traffic Light - Educational Example
- * This shows what the traffic light logic looks like in ARM assembly
- * 
- * Note: This is a conceptual example. The actual Pi 5 code uses libgpiod
- * library calls which can't be done in pure assembly easily. This shows
- * the state machine logic and bit manipulation in ARM.
- */
-
-// GPIO Pin definitions (as immediate values)
-.equ STREET_A_RED,    17
-.equ STREET_A_YELLOW, 27
-.equ STREET_A_GREEN,  22
-.equ STREET_B_RED,    23
-.equ STREET_B_YELLOW, 24
-.equ STREET_B_GREEN,  25
-
-// State definitions
-.equ STATE_A_GREEN,   0
-.equ STATE_A_YELLOW,  1
-.equ STATE_BOTH_RED1, 2
-.equ STATE_B_GREEN,   3
-.equ STATE_B_YELLOW,  4
-.equ STATE_BOTH_RED2, 5
-
-// Timing (in loop iterations - approximate)
-.equ GREEN_DELAY,     0x4C4B40    // ~5 seconds worth of loops
-.equ YELLOW_DELAY,    0xF4240     // ~1 second
-.equ BUFFER_DELAY,    0xF4240     // ~1 second
-
-.section .data
-current_state:  .word 0           // Current state machine state
-cycle_count:    .word 0           // Number of complete cycles
-
-// Bit masks for each LED (1 << pin_number)
-mask_a_red:     .word (1 << STREET_A_RED)
-mask_a_yellow:  .word (1 << STREET_A_YELLOW)
-mask_a_green:   .word (1 << STREET_A_GREEN)
-mask_b_red:     .word (1 << STREET_B_RED)
-mask_b_yellow:  .word (1 << STREET_B_YELLOW)
-mask_b_green:   .word (1 << STREET_B_GREEN)
-
-.section .text
-.global traffic_light_asm
-
-// Main traffic light function (conceptual)
-// In reality, this would need to interface with libgpiod
-traffic_light_asm:
-    // Save registers we'll use
-    stp     x29, x30, [sp, #-16]!   // Push frame pointer and link register
-    mov     x29, sp                  // Set up frame pointer
-    
-    // Initialize state to 0
-    adrp    x0, current_state        // Load page address of current_state
-    add     x0, x0, :lo12:current_state
-    str     wzr, [x0]                // Store zero to current_state
-    
-main_loop:
-    // Load current state
-    adrp    x0, current_state
-    add     x0, x0, :lo12:current_state
-    ldr     w1, [x0]                 // w1 = current state
-    
-    // Branch based on state
-    cmp     w1, #STATE_A_GREEN
-    b.eq    state_a_green
-    cmp     w1, #STATE_A_YELLOW
-    b.eq    state_a_yellow
-    cmp     w1, #STATE_BOTH_RED1
-    b.eq    state_both_red_1
-    cmp     w1, #STATE_B_GREEN
-    b.eq    state_b_green
-    cmp     w1, #STATE_B_YELLOW
-    b.eq    state_b_yellow
-    cmp     w1, #STATE_BOTH_RED2
-    b.eq    state_both_red_2
-    
-    // Default - reset to state 0
-    str     wzr, [x0]
-    b       main_loop
-
-// State: Street A Green, Street B Red
-state_a_green:
-    // Turn off all lights first
-    bl      all_lights_off
-    
-    // Turn on Street A Green (GPIO 22)
-    adrp    x0, mask_a_green
-    add     x0, x0, :lo12:mask_a_green
-    ldr     w1, [x0]                 // w1 = bit mask for green LED
-    // [Would call gpio_set_high here with w1]
-    
-    // Turn on Street B Red (GPIO 23)
-    adrp    x0, mask_b_red
-    add     x0, x0, :lo12:mask_b_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here with w1]
-    
-    // Delay for green time
-    mov     w0, #GREEN_DELAY
-    bl      delay_loop
-    
-    // Advance to next state
-    mov     w1, #STATE_A_YELLOW
-    adrp    x0, current_state
-    add     x0, x0, :lo12:current_state
-    str     w1, [x0]
-    b       main_loop
-
-// State: Street A Yellow, Street B Red  
-state_a_yellow:
-    bl      all_lights_off
-    
-    // Turn on Street A Yellow (GPIO 27)
-    adrp    x0, mask_a_yellow
-    add     x0, x0, :lo12:mask_a_yellow
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Turn on Street B Red (GPIO 23)
-    adrp    x0, mask_b_red
-    add     x0, x0, :lo12:mask_b_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Delay for yellow time
-    mov     w0, #YELLOW_DELAY
-    bl      delay_loop
-    
-    // Advance to next state
-    mov     w1, #STATE_BOTH_RED1
-    adrp    x0, current_state
-    add     x0, x0, :lo12:current_state
-    str     w1, [x0]
-    b       main_loop
-
-// State: Both Red (safety buffer)
-state_both_red_1:
-    bl      all_lights_off
-    
-    // Turn on both red lights
-    adrp    x0, mask_a_red
-    add     x0, x0, :lo12:mask_a_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    adrp    x0, mask_b_red
-    add     x0, x0, :lo12:mask_b_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Delay for buffer time
-    mov     w0, #BUFFER_DELAY
-    bl      delay_loop
-    
-    // Advance to next state
-    mov     w1, #STATE_B_GREEN
-    adrp    x0, current_state
-    add     x0, x0, :lo12:current_state
-    str     w1, [x0]
-    b       main_loop
-
-// State: Street A Red, Street B Green
-state_b_green:
-    bl      all_lights_off
-    
-    // Turn on Street A Red (GPIO 17)
-    adrp    x0, mask_a_red
-    add     x0, x0, :lo12:mask_a_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Turn on Street B Green (GPIO 25)
-    adrp    x0, mask_b_green
-    add     x0, x0, :lo12:mask_b_green
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Delay for green time
-    mov     w0, #GREEN_DELAY
-    bl      delay_loop
-    
-    // Advance to next state
-    mov     w1, #STATE_B_YELLOW
-    adrp    x0, current_state
-    add     x0, x0, :lo12:current_state
-    str     w1, [x0]
-    b       main_loop
-
-// State: Street A Red, Street B Yellow
-state_b_yellow:
-    bl      all_lights_off
-    
-    // Turn on Street A Red (GPIO 17)
-    adrp    x0, mask_a_red
-    add     x0, x0, :lo12:mask_a_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Turn on Street B Yellow (GPIO 24)
-    adrp    x0, mask_b_yellow
-    add     x0, x0, :lo12:mask_b_yellow
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Delay for yellow time
-    mov     w0, #YELLOW_DELAY
-    bl      delay_loop
-    
-    // Advance to next state
-    mov     w1, #STATE_BOTH_RED2
-    adrp    x0, current_state
-    add     x0, x0, :lo12:current_state
-    str     w1, [x0]
-    b       main_loop
-
-// State: Both Red (safety buffer before cycle repeats)
-state_both_red_2:
-    bl      all_lights_off
-    
-    // Turn on both red lights
-    adrp    x0, mask_a_red
-    add     x0, x0, :lo12:mask_a_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    adrp    x0, mask_b_red
-    add     x0, x0, :lo12:mask_b_red
-    ldr     w1, [x0]
-    // [Would call gpio_set_high here]
-    
-    // Delay for buffer time
-    mov     w0, #BUFFER_DELAY
-    bl      delay_loop
-    
-    // Increment cycle counter
-    adrp    x0, cycle_count
-    add     x0, x0, :lo12:cycle_count
-    ldr     w1, [x0]
-    add     w1, w1, #1
-    str     w1, [x0]
-    
-    // Reset to state 0 (restart cycle)
-    adrp    x0, current_state
-    add     x0, x0, :lo12:current_state
-    str     wzr, [x0]
-    b       main_loop
-
-// Turn off all lights
-// In real implementation, would call gpio_clear for all 6 pins
-all_lights_off:
-    // This would iterate through all 6 GPIO pins and clear them
-    // For now, just a placeholder
-    ret
-
-// Delay loop - counts down from w0
-// Input: w0 = number of iterations
-delay_loop:
-    subs    w0, w0, #1          // Subtract 1 and set flags
-    b.ne    delay_loop          // Branch if Not Equal (w0 != 0)
-    ret                         // Return when w0 reaches 0
-
-
-/*
- * KEY ARM ASSEMBLY INSTRUCTIONS DEMONSTRATED:
- * 
- * 1. STP/LDP - Store/Load Pair (push/pop registers)
- *    stp x29, x30, [sp, #-16]!    // Push two registers, decrement stack pointer
- * 
- * 2. ADRP/ADD - Address calculation (position-independent code)
- *    adrp x0, label               // Load page address of label
- *    add x0, x0, :lo12:label      // Add low 12 bits offset
- * 
- * 3. LDR/STR - Load/Store Register
- *    ldr w1, [x0]                 // Load 32-bit word from memory
- *    str w1, [x0]                 // Store 32-bit word to memory
- * 
- * 4. CMP - Compare (sets flags)
- *    cmp w1, #STATE_A_GREEN       // Compare w1 with immediate value
- * 
- * 5. B.EQ, B.NE - Conditional Branch
- *    b.eq label                   // Branch if equal (Z flag set)
- *    b.ne label                   // Branch if not equal (Z flag clear)
- * 
- * 6. BL - Branch with Link (function call)
- *    bl function                  // Call function, save return address in x30
- * 
- * 7. RET - Return from function
- *    ret                          // Return (jump to address in x30)
- * 
- * 8. SUBS - Subtract and Set flags
- *    subs w0, w0, #1              // w0 = w0 - 1, update flags
- * 
- * 9. MOV - Move immediate
- *    mov w1, #5                   // w1 = 5
- * 
- * 10. STR WZR - Store Zero Register
- *     str wzr, [x0]               // Store 0 to memory (wzr always = 0)
- */
-
-/*
- * COMPARISON TO MIPS:
- * 
- * ARM                          | MIPS Equivalent
- * -----------------------------|----------------------------------
- * ldr w1, [x0]                 | lw $t1, 0($t0)
- * str w1, [x0]                 | sw $t1, 0($t0)
- * mov w1, #5                   | li $t1, 5
- * add w2, w1, w0              | add $t2, $t1, $t0
- * subs w0, w0, #1             | addi $t0, $t0, -1
- * b.eq label                   | beq $t0, $zero, label
- * bl function                  | jal function
- * ret                          | jr $ra
- * 
- * KEY DIFFERENCES:
- * - ARM uses x0-x30 (64-bit) or w0-w30 (32-bit) registers
- * - MIPS uses $t0-$t9, $s0-$s7, etc.
- * - ARM can do immediate operands in more instructions
- * - ARM has conditional execution on many instructions
- * - MIPS has delay slots, ARM doesn't
- * - ARM position-independent code uses ADRP/ADD
- * - MIPS uses absolute or PC-relative addressing
- */
@@ -0,0 +1,72 @@
+/*
+ * Minimal traffic light on the assembly state machine
+ *
+ * Runs the standard cycle from tl_default_table in traffic_light_asm.s:
+ * map the GPIO registers, make the six pins outputs, then hand over to the
+ * assembly loop. No threads, no libgpiod and no config file, so a static
+ * build is small enough for an initramfs, and the loop itself needs
+ * nothing from the OS at all.
+ *
+ * Compile: see CMakeLists.txt (target "traffic_light_bare", AArch64 only)
+ * Run: sudo ./traffic_light_bare [rp1|mmap]
+ *
+ * Press Ctrl+C to exit
+ */
+
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include "gpio_backend.h"
+#include "gpio_mmap.h"
+#include "gpio_rp1.h"
+#include "traffic_light_asm.h"
+
+volatile int keep_running = 1;
+
+// Signal handler for clean exit
+void signal_handler(int sig) {
+    keep_running = 0;
+}
+
+int main(int argc, char *argv[]) {
+    const struct gpio_backend *backend = &gpio_rp1_backend;
+    struct tl_ctx ctx = { .table = tl_default_table };
+    unsigned int pins[32];
+    int num_pins = 0;
+    
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "rp1") != 0 && strcmp(argv[1], "mmap") != 0)) {
+        fprintf(stderr, "Usage: %s [rp1|mmap]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2 && strcmp(argv[1], "mmap") == 0) backend = &gpio_mmap_backend;
+    
+    for (int i = 0; i < TL_DEFAULT_PHASES; i++) ctx.all_mask |= tl_default_table[i].mask;
+    for (unsigned int pin = 0; pin < 32; pin++) {
+        if (ctx.all_mask & (1u << pin)) pins[num_pins++] = pin;
+    }
+    
+    if (backend->init() != 0) return 1;
+    if (backend->configure_outputs(pins, num_pins) != 0) {
+        backend->close();
+        return 1;
+    }
+    if (backend == &gpio_rp1_backend) {
+        ctx.set_reg = rp1_reg(RP1_SYS_RIO0 + RP1_ALIAS_SET + RP1_RIO_OUT);
+        ctx.clear_reg = rp1_reg(RP1_SYS_RIO0 + RP1_ALIAS_CLR + RP1_RIO_OUT);
+    } else {
+        ctx.set_reg = &gpio[GPSET0];
+        ctx.clear_reg = &gpio[GPCLR0];
+    }
+    
+    signal(SIGINT, signal_handler);
+    printf("Running the standard cycle through %s, timed by the %llu Hz generic timer "
+           "(Press Ctrl+C to exit)\n", backend->name, (unsigned long long)tl_counter_hz());
+    
+    tl_run(&ctx, &keep_running);
+    
+    // Clean up - turn off all lights
+    tl_apply(ctx.set_reg, ctx.clear_reg, 0, ctx.all_mask);
+    backend->close();
+    printf("\nStopped after %u cycles\n", ctx.cycle);
+    return 0;
+}